@@ -0,0 +1,332 @@
+#include "AdaptiveDownloader.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <gmock/gmock.h>
+
+using namespace testing;
+
+namespace
+{
+    const double Smoothing = 0.2;
+    // Transfers after which a baseline nobody has matched again is considered stale.
+    const size_t BaselineWindow = 200;
+
+    // Holds a host slot for one transfer; unless Release is called (the transfer threw or failed), the slot is aborted.
+    class HostSlot
+    {
+    public:
+        HostSlot(HostController& controller, const std::string& host)
+            : m_controller(controller)
+            , m_host(host)
+            , m_bufferSize(controller.Acquire(host))
+        {}
+
+        ~HostSlot()
+        {
+            if (!m_released)
+            {
+                m_controller.Abort(m_host);
+            }
+        }
+
+        HostSlot(const HostSlot&) = delete;
+        HostSlot& operator=(const HostSlot&) = delete;
+
+        long BufferSize() const { return m_bufferSize; }
+
+        void Release(uint64_t bytes, std::chrono::microseconds latency, std::chrono::microseconds duration)
+        {
+            m_released = true;
+            m_controller.Release(m_host, bytes, latency, duration);
+        }
+
+    private:
+        HostController& m_controller;
+        const std::string& m_host;
+        const long m_bufferSize;
+        bool m_released = false;
+    };
+
+    template <typename TUrl>
+    std::string Download(const Downloader& downloader, HostController& controller, const std::string& host,
+                         const TUrl& url)
+    {
+        HostSlot slot(controller, host);
+        std::chrono::microseconds firstByte(0);
+        const auto start = std::chrono::steady_clock::now();
+        std::string data = downloader.DownloadData(url, slot.BufferSize(), firstByte);
+        // Downloader reports a failed transfer as an empty body with no first byte rather than throwing; such a
+        // sample says nothing about the path, so the slot is aborted instead of feeding it into the estimates.
+        if (!data.empty() && firstByte.count() > 0)
+        {
+            slot.Release(data.size(), firstByte, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start));
+        }
+        return data;
+    }
+}
+
+HostController::HostController(size_t initialInFlight, size_t maxInFlight, long minBufferSize, long maxBufferSize)
+    : m_initialInFlight(std::max<size_t>(initialInFlight, 1))
+    , m_maxInFlight(std::max(maxInFlight, m_initialInFlight))
+    , m_minBufferSize(minBufferSize)
+    , m_maxBufferSize(std::max(maxBufferSize, minBufferSize))
+{}
+
+long HostController::Acquire(const std::string& host)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    HostState& state = StateFor(host);
+    m_slotFreed.wait(lock, [&state]() { return state.inFlight < state.maxInFlight; });
+    ++state.inFlight;
+    return state.bufferSize;
+}
+
+void HostController::Release(const std::string& host, uint64_t bytes, std::chrono::microseconds latency,
+                             std::chrono::microseconds duration)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        HostState& state = StateFor(host);
+        --state.inFlight;
+        latency = std::max(latency, std::chrono::microseconds(1));
+        duration = std::max(duration, std::chrono::microseconds(1));
+        const double throughput = bytes * 1e6 / duration.count();
+        bool probing = false;
+        if (state.minLatency.count() == 0)
+        {
+            state.throughput = throughput;
+            state.latency = latency;
+            state.minLatency = latency;
+        }
+        else
+        {
+            state.throughput += Smoothing * (throughput - state.throughput);
+            state.latency += std::chrono::microseconds(
+                static_cast<int64_t>(Smoothing * (latency - state.latency).count()));
+            if (latency <= state.minLatency)
+            {
+                state.minLatency = latency;
+                state.baselineAge = 0;
+            }
+            else if (++state.baselineAge >= BaselineWindow)
+            {
+                // Probe: drop back to the initial concurrency so the next samples show the path without our own
+                // queueing, and let the baseline restart from them.
+                state.minLatency = latency;
+                state.latency = latency;
+                state.baselineAge = 0;
+                state.maxInFlight = std::min(state.maxInFlight, m_initialInFlight);
+                probing = true;
+            }
+        }
+
+        if (!probing && state.latency > 2 * state.minLatency)
+        {
+            state.maxInFlight = std::max<size_t>(state.maxInFlight / 2, 1);
+            // Forget the congested average so the next decision is based on fresh samples.
+            state.latency = state.minLatency;
+        }
+        else if (!probing && state.maxInFlight < m_maxInFlight)
+        {
+            ++state.maxInFlight;
+        }
+
+        const double bandwidthDelay = state.throughput * state.minLatency.count() / 1e6;
+        long bufferSize = m_minBufferSize;
+        while (bufferSize < bandwidthDelay && bufferSize < m_maxBufferSize)
+        {
+            bufferSize *= 2;
+        }
+        state.bufferSize = std::min(bufferSize, m_maxBufferSize);
+    }
+    m_slotFreed.notify_all();
+}
+
+void HostController::Abort(const std::string& host)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --StateFor(host).inFlight;
+    }
+    m_slotFreed.notify_all();
+}
+
+std::map<std::string, HostState> HostController::Snapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hosts;
+}
+
+HostState& HostController::StateFor(const std::string& host)
+{
+    auto result = m_hosts.emplace(host, HostState());
+    if (result.second)
+    {
+        result.first->second.maxInFlight = m_initialInFlight;
+        result.first->second.bufferSize = m_minBufferSize;
+    }
+    return result.first->second;
+}
+
+AdaptiveDownloader::AdaptiveDownloader(const Downloader& downloader, HostController& controller)
+    : m_downloader(downloader)
+    , m_controller(controller)
+{}
+
+std::string AdaptiveDownloader::DownloadData(const std::string& url) const
+{
+    // Parsed without interning: callers may pass any number of distinct urls.
+    return Download(m_downloader, m_controller, std::string(Url::Parse(url).host), url);
+}
+
+std::string AdaptiveDownloader::DownloadData(const Url& url) const
+{
+    return Download(m_downloader, m_controller, std::string(url.Host()), url);
+}
+
+namespace
+{
+    class MockDownloader : public Downloader
+    {
+    public:
+        using Downloader::DownloadData;
+        MOCK_CONST_METHOD3(DownloadData, std::string(const std::string&, long, std::chrono::microseconds&));
+        MOCK_CONST_METHOD3(DownloadData, std::string(const Url&, long, std::chrono::microseconds&));
+    };
+
+    // Host that serves `capacity` transfers in parallel at full speed and queues the rest.
+    std::chrono::microseconds SimulatedLatency(const HostState& state, size_t capacity)
+    {
+        const size_t queued = (state.maxInFlight + capacity - 1) / capacity;
+        return std::chrono::microseconds(1000 * queued);
+    }
+}
+
+TEST(HostController, ConvergesPerHost)
+{
+    HostController controller(4, 64);
+    for (int i = 0; i < 500; ++i)
+    {
+        for (const auto& host : { std::make_pair("fast", size_t(64)), std::make_pair("slow", size_t(4)) })
+        {
+            controller.Acquire(host.first);
+            const HostState state = controller.Snapshot().at(host.first);
+            const auto latency = SimulatedLatency(state, host.second);
+            controller.Release(host.first, 64 * 1024, latency, latency);
+        }
+    }
+    const auto hosts = controller.Snapshot();
+    EXPECT_GE(hosts.at("fast").maxInFlight, 32u);
+    EXPECT_LE(hosts.at("slow").maxInFlight, 12u);
+    EXPECT_EQ(hosts.at("fast").inFlight, 0u);
+    EXPECT_EQ(hosts.at("fast").minLatency, std::chrono::milliseconds(1));
+}
+
+TEST(HostController, BufferSizeFollowsBandwidthDelayProduct)
+{
+    HostController controller(1, 1, 16 * 1024, 512 * 1024);
+    EXPECT_EQ(controller.Acquire("localhost"), 16 * 1024);
+    // 100 MB/s with 2 ms latency -> ~200 KB in flight.
+    controller.Release("localhost", 200 * 1000, std::chrono::milliseconds(2), std::chrono::milliseconds(2));
+    EXPECT_EQ(controller.Acquire("localhost"), 256 * 1024);
+    controller.Release("localhost", 10 * 1000 * 1000, std::chrono::milliseconds(2), std::chrono::milliseconds(2));
+    EXPECT_EQ(controller.Snapshot().at("localhost").bufferSize, 512 * 1024);
+}
+
+TEST(HostController, AcquireWaitsForFreeSlot)
+{
+    HostController controller(1, 1);
+    controller.Acquire("localhost");
+    std::atomic<bool> acquired{ false };
+    std::thread waiter([&]() {
+        controller.Acquire("localhost");
+        acquired = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(acquired);
+    controller.Release("localhost", 0, std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    waiter.join();
+    EXPECT_TRUE(acquired);
+}
+
+TEST(HostController, LargeTransfersDoNotLookLikeCongestion)
+{
+    HostController controller(4, 64);
+    for (int i = 0; i < 200; ++i)
+    {
+        controller.Acquire("localhost");
+        // Same time to first byte; every other transfer is a thousand times larger and takes that much longer.
+        const bool large = i % 2 == 1;
+        controller.Release("localhost", large ? 64 * 1024 * 1024 : 64 * 1024, std::chrono::milliseconds(1),
+                           std::chrono::milliseconds(large ? 1000 : 1));
+    }
+    EXPECT_EQ(controller.Snapshot().at("localhost").maxInFlight, 64u);
+}
+
+TEST(HostController, BaselineLatencyAgesOut)
+{
+    HostController controller(4, 64);
+    for (int i = 0; i < 100; ++i)
+    {
+        controller.Acquire("localhost");
+        controller.Release("localhost", 64 * 1024, std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    }
+    // The path got slower for good: after a while that is the new baseline and concurrency grows again.
+    for (int i = 0; i < 400; ++i)
+    {
+        controller.Acquire("localhost");
+        controller.Release("localhost", 64 * 1024, std::chrono::milliseconds(5), std::chrono::milliseconds(5));
+    }
+    const HostState state = controller.Snapshot().at("localhost");
+    EXPECT_GT(state.minLatency, std::chrono::milliseconds(4));
+    EXPECT_EQ(state.maxInFlight, 64u);
+}
+
+TEST(AdaptiveDownloader, DownloadDataUsesControllerBufferSize)
+{
+    MockDownloader downloader;
+    HostController controller;
+    AdaptiveDownloader adaptive(downloader, controller);
+    EXPECT_CALL(downloader, DownloadData(Matcher<const std::string&>("http://localhost/aaa.txt"), 16 * 1024, _))
+        .WillOnce(Return("FileContent"));
+    EXPECT_CALL(downloader, DownloadData(Url("http://localhost/aaa.txt"), 16 * 1024, _)).WillOnce(Return("FileContent"));
+    EXPECT_EQ(adaptive.DownloadData("http://localhost/aaa.txt"), "FileContent");
+    EXPECT_EQ(adaptive.DownloadData(Url("http://localhost/aaa.txt")), "FileContent");
+    const auto hosts = controller.Snapshot();
+    ASSERT_EQ(hosts.count("localhost"), 1u);
+    EXPECT_EQ(hosts.at("localhost").inFlight, 0u);
+}
+
+TEST(AdaptiveDownloader, FailedTransfersDoNotFeedLatencyModel)
+{
+    MockDownloader downloader;
+    HostController controller(4, 64);
+    AdaptiveDownloader adaptive(downloader, controller);
+    EXPECT_CALL(downloader, DownloadData(Matcher<const std::string&>(_), _, _))
+        .WillOnce(DoAll(SetArgReferee<2>(std::chrono::milliseconds(2)), Return("FileContent")))
+        .WillRepeatedly(DoAll(SetArgReferee<2>(std::chrono::microseconds(0)), Return("")));
+    EXPECT_EQ(adaptive.DownloadData("http://localhost/aaa.txt"), "FileContent");
+    for (int i = 0; i < 20; ++i)
+    {
+        EXPECT_EQ(adaptive.DownloadData("http://localhost/aaa.txt"), "");
+    }
+    const HostState state = controller.Snapshot().at("localhost");
+    EXPECT_EQ(state.minLatency, std::chrono::milliseconds(2));
+    EXPECT_EQ(state.maxInFlight, 5u);
+    EXPECT_EQ(state.inFlight, 0u);
+}
+
+TEST(AdaptiveDownloader, FailedDownloadReleasesHostSlot)
+{
+    MockDownloader downloader;
+    HostController controller(1, 1);
+    AdaptiveDownloader adaptive(downloader, controller);
+    EXPECT_CALL(downloader, DownloadData(Matcher<const std::string&>(_), _, _))
+        .WillOnce(Throw(std::runtime_error("connection reset")))
+        .WillOnce(Return("FileContent"));
+    EXPECT_THROW(adaptive.DownloadData("http://localhost/aaa.txt"), std::runtime_error);
+    EXPECT_EQ(controller.Snapshot().at("localhost").inFlight, 0u);
+    EXPECT_EQ(adaptive.DownloadData("http://localhost/aaa.txt"), "FileContent");
+}
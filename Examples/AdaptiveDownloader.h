@@ -0,0 +1,65 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "Downloader.h"
+
+struct HostState
+{
+    size_t maxInFlight = 0;
+    size_t inFlight = 0;
+    long bufferSize = 0;
+    double throughput = 0;  // bytes per second, moving average
+    std::chrono::microseconds latency{ 0 };  // time to first byte, moving average
+    std::chrono::microseconds minLatency{ 0 };  // baseline: lowest latency seen recently
+    size_t baselineAge = 0;  // transfers since the baseline was last matched
+};
+
+// Per-host AIMD controller. Latency is the time to first byte, so it does not depend on the body size.
+// Concurrency grows by one per transfer while latency stays close to the host's baseline and is halved
+// when latency doubles (queueing somewhere). A baseline that no transfer has matched for a while is re-probed
+// at the initial concurrency, so a lasting change of the path becomes the new normal. Receive buffer follows
+// the bandwidth-delay product estimated from throughput and baseline latency.
+class HostController
+{
+public:
+    HostController(size_t initialInFlight = 4, size_t maxInFlight = 64, long minBufferSize = 16 * 1024,
+                   long maxBufferSize = 512 * 1024);
+
+    // Blocks until the host has a free slot and returns the buffer size to use for the transfer.
+    long Acquire(const std::string& host);
+    void Release(const std::string& host, uint64_t bytes, std::chrono::microseconds latency,
+                 std::chrono::microseconds duration);
+    // Frees the slot of a transfer that failed, without feeding it into the estimates.
+    void Abort(const std::string& host);
+    std::map<std::string, HostState> Snapshot() const;
+
+private:
+    HostState& StateFor(const std::string& host);
+
+    const size_t m_initialInFlight;
+    const size_t m_maxInFlight;
+    const long m_minBufferSize;
+    const long m_maxBufferSize;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_slotFreed;
+    std::map<std::string, HostState> m_hosts;
+};
+
+class AdaptiveDownloader : public IDownloader
+{
+public:
+    AdaptiveDownloader(const Downloader& downloader, HostController& controller);
+
+    using IDownloader::DownloadData;
+    virtual std::string DownloadData(const std::string& url) const;
+    virtual std::string DownloadData(const Url& url) const;
+
+private:
+    const Downloader& m_downloader;
+    HostController& m_controller;
+};
@@ -0,0 +1,388 @@
+#include "BufferPool.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+#include <gtest/gtest.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace
+{
+    std::atomic<uint64_t> s_nextPoolId{ 1 };
+
+    // Live pools by id, so an exiting thread only returns caches to pools that still exist.
+    struct PoolRegistry
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, BufferPool*> pools;
+    };
+
+    PoolRegistry& Registry()
+    {
+        static PoolRegistry registry;
+        return registry;
+    }
+
+    uint64_t ResidentBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.WorkingSetSize;
+        }
+#elif defined(__linux__)
+        std::ifstream statm("/proc/self/statm");
+        uint64_t pages = 0;
+        uint64_t resident = 0;
+        if (statm >> pages >> resident)
+        {
+            return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        }
+#endif
+        return 0;
+    }
+}
+
+double BufferPoolStats::HitRate() const
+{
+    const uint64_t total = hits + misses;
+    return total > 0 ? static_cast<double>(hits) / total : 0.0;
+}
+
+BufferPool::BufferPool(uint64_t maxCachedBytes, size_t threadCacheSlots)
+    : m_maxCachedBytes(maxCachedBytes)
+    , m_threadCacheSlots(threadCacheSlots)
+    , m_id(s_nextPoolId++)
+{
+    PoolRegistry& registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.pools[m_id] = this;
+}
+
+BufferPool::~BufferPool()
+{
+    {
+        PoolRegistry& registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.pools.erase(m_id);
+    }
+    Trim(0);
+}
+
+BufferPool& BufferPool::Instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+struct BufferPool::LocalCaches
+{
+    std::unordered_map<uint64_t, ThreadCache*> caches;
+
+    ~LocalCaches()
+    {
+        PoolRegistry& registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto& entry : caches)
+        {
+            const auto pool = registry.pools.find(entry.first);
+            if (pool != registry.pools.end())
+            {
+                pool->second->RetireCache(entry.second);
+            }
+        }
+    }
+};
+
+// Caches belong to the pool, which frees them if it goes away first. Pools are looked up by an id that is
+// never reused, so a destroyed pool's entry is simply never hit again.
+BufferPool::ThreadCache& BufferPool::LocalCache()
+{
+    thread_local LocalCaches local;
+    ThreadCache*& cache = local.caches[m_id];
+    if (cache == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threadCaches.push_back(std::make_unique<ThreadCache>());
+        cache = m_threadCaches.back().get();
+    }
+    return *cache;
+}
+
+// Called when the owning thread exits: its idle slabs move to the shared lists where other threads reuse them.
+void BufferPool::RetireCache(ThreadCache* cache)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t index = 0; index < kClassCount; ++index)
+    {
+        auto& slabs = cache->slabs[index];
+        m_shared[index].insert(m_shared[index].end(), slabs.begin(), slabs.end());
+    }
+    m_threadCaches.erase(std::find_if(m_threadCaches.begin(), m_threadCaches.end(),
+                                      [cache](const std::unique_ptr<ThreadCache>& owned) { return owned.get() == cache; }));
+}
+
+size_t BufferPool::ClassFor(size_t size)
+{
+    size_t index = 0;
+    while ((kMinSlab << index) < size)
+    {
+        ++index;
+    }
+    return index;
+}
+
+bool BufferPool::TakeFrom(std::mutex& mutex, std::vector<char*>& slabs, char*& data)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slabs.empty())
+    {
+        return false;
+    }
+    data = slabs.back();
+    slabs.pop_back();
+    return true;
+}
+
+char* BufferPool::Acquire(size_t size, size_t& capacity)
+{
+    if (size > kMaxSlab)
+    {
+        ++m_misses;
+        capacity = size;
+        return new char[size];
+    }
+    const size_t index = ClassFor(size);
+    capacity = kMinSlab << index;
+    char* data = nullptr;
+    ThreadCache& cache = LocalCache();
+    if (TakeFrom(cache.mutex, cache.slabs[index], data) || TakeFrom(m_mutex, m_shared[index], data))
+    {
+        m_cachedBytes -= capacity;
+        ++m_hits;
+        return data;
+    }
+    ++m_misses;
+    return new char[capacity];
+}
+
+void BufferPool::Release(char* data, size_t capacity)
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    const bool pooled = capacity <= kMaxSlab && capacity == (kMinSlab << ClassFor(capacity));
+    if (!pooled || m_cachedBytes.fetch_add(capacity) + capacity > m_maxCachedBytes)
+    {
+        if (pooled)
+        {
+            m_cachedBytes -= capacity;
+        }
+        delete[] data;
+        return;
+    }
+    const size_t index = ClassFor(capacity);
+    ThreadCache& cache = LocalCache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.slabs[index].size() < m_threadCacheSlots)
+        {
+            cache.slabs[index].push_back(data);
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shared[index].push_back(data);
+}
+
+void BufferPool::Trim(uint64_t keepBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto drain = [this, keepBytes](FreeLists& lists) {
+        for (size_t index = kClassCount; index-- > 0;)
+        {
+            auto& slabs = lists[index];
+            while (!slabs.empty() && m_cachedBytes > keepBytes)
+            {
+                delete[] slabs.back();
+                slabs.pop_back();
+                m_cachedBytes -= kMinSlab << index;
+                m_trimmedBytes += kMinSlab << index;
+            }
+        }
+    };
+    drain(m_shared);
+    for (auto& cache : m_threadCaches)
+    {
+        std::lock_guard<std::mutex> cacheLock(cache->mutex);
+        drain(cache->slabs);
+    }
+}
+
+BufferPoolStats BufferPool::Stats() const
+{
+    BufferPoolStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.cachedBytes = m_cachedBytes;
+    stats.trimmedBytes = m_trimmedBytes;
+    stats.residentBytes = ResidentBytes();
+    return stats;
+}
+
+PooledBuffer::PooledBuffer(BufferPool& pool)
+    : m_pool(pool)
+{}
+
+PooledBuffer::~PooledBuffer()
+{
+    m_pool.Release(m_data, m_capacity);
+}
+
+void PooledBuffer::Reserve(size_t capacity)
+{
+    if (capacity <= m_capacity)
+    {
+        return;
+    }
+    size_t newCapacity = 0;
+    char* data = m_pool.Acquire(capacity, newCapacity);
+    if (m_size > 0)
+    {
+        std::memcpy(data, m_data, m_size);
+    }
+    m_pool.Release(m_data, m_capacity);
+    m_data = data;
+    m_capacity = newCapacity;
+}
+
+void PooledBuffer::Append(const char* data, size_t size)
+{
+    if (m_size + size > m_capacity)
+    {
+        Reserve(std::max(m_size + size, m_capacity * 2));
+    }
+    std::memcpy(m_data + m_size, data, size);
+    m_size += size;
+}
+
+void PooledBuffer::Clear()
+{
+    m_size = 0;
+}
+
+const char* PooledBuffer::Data() const
+{
+    return m_data;
+}
+
+size_t PooledBuffer::Size() const
+{
+    return m_size;
+}
+
+size_t PooledBuffer::Capacity() const
+{
+    return m_capacity;
+}
+
+TEST(BufferPool, ReleasedSlabIsReused)
+{
+    BufferPool pool;
+    size_t capacity = 0;
+    char* first = pool.Acquire(1000, capacity);
+    EXPECT_EQ(capacity, BufferPool::kMinSlab);
+    pool.Release(first, capacity);
+    EXPECT_EQ(pool.Stats().cachedBytes, BufferPool::kMinSlab);
+    char* second = pool.Acquire(BufferPool::kMinSlab, capacity);
+    EXPECT_EQ(second, first);
+    pool.Release(second, capacity);
+
+    const BufferPoolStats stats = pool.Stats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_DOUBLE_EQ(stats.HitRate(), 0.5);
+}
+
+TEST(BufferPool, CachedBytesStayWithinCap)
+{
+    BufferPool pool(3 * BufferPool::kMinSlab, 1);
+    std::vector<char*> slabs;
+    size_t capacity = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        slabs.push_back(pool.Acquire(1, capacity));
+    }
+    for (char* slab : slabs)
+    {
+        pool.Release(slab, capacity);
+    }
+    EXPECT_EQ(pool.Stats().cachedBytes, 3 * BufferPool::kMinSlab);
+    pool.Trim(BufferPool::kMinSlab);
+    EXPECT_EQ(pool.Stats().cachedBytes, BufferPool::kMinSlab);
+    EXPECT_EQ(pool.Stats().trimmedBytes, 2 * BufferPool::kMinSlab);
+}
+
+TEST(BufferPool, SlabsReleasedOnOtherThreadAreTrimmed)
+{
+    BufferPool pool;
+    std::thread worker([&pool]() {
+        size_t capacity = 0;
+        char* slab = pool.Acquire(100000, capacity);
+        pool.Release(slab, capacity);
+    });
+    worker.join();
+    EXPECT_EQ(pool.Stats().cachedBytes, 128u * 1024);
+    pool.Trim();
+    EXPECT_EQ(pool.Stats().cachedBytes, 0u);
+}
+
+TEST(BufferPool, ExitingThreadReturnsItsSlabs)
+{
+    BufferPool pool;
+    char* released = nullptr;
+    std::thread worker([&pool, &released]() {
+        size_t capacity = 0;
+        released = pool.Acquire(1000, capacity);
+        pool.Release(released, capacity);
+    });
+    worker.join();
+    size_t capacity = 0;
+    char* slab = pool.Acquire(1000, capacity);
+    EXPECT_EQ(slab, released);
+    EXPECT_EQ(pool.Stats().hits, 1u);
+    pool.Release(slab, capacity);
+}
+
+TEST(PooledBuffer, AppendGrowsAndReturnsStorage)
+{
+    BufferPool pool;
+    {
+        PooledBuffer buffer(pool);
+        std::string expected;
+        for (int i = 0; i < 5000; ++i)
+        {
+            const std::string chunk = "chunk" + std::to_string(i);
+            buffer.Append(chunk.data(), chunk.size());
+            expected += chunk;
+        }
+        EXPECT_EQ(std::string(buffer.Data(), buffer.Size()), expected);
+        EXPECT_GE(buffer.Capacity(), expected.size());
+    }
+    EXPECT_GT(pool.Stats().cachedBytes, 0u);
+    {
+        PooledBuffer buffer(pool);
+        buffer.Reserve(10);
+        EXPECT_EQ(pool.Stats().hits, 1u);
+    }
+}
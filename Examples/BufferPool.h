@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct BufferPoolStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Bytes held by the pool in free slabs, per-thread caches included.
+    uint64_t cachedBytes = 0;
+    uint64_t trimmedBytes = 0;
+    // Resident set of the whole process, 0 where the platform does not report it.
+    uint64_t residentBytes = 0;
+
+    double HitRate() const;
+};
+
+// Recycles transfer buffers in power-of-two size classes from 16 KiB to 16 MiB. Each thread first
+// uses its own cache, which only it locks in the common case; slabs that don't fit there, and the whole
+// cache once the thread exits, go to a shared free list. Idle slabs are capped at `maxCachedBytes` in total, anything above it is freed.
+class BufferPool
+{
+public:
+    static constexpr size_t kMinSlab = 16 * 1024;
+    static constexpr size_t kMaxSlab = 16 * 1024 * 1024;
+
+    explicit BufferPool(uint64_t maxCachedBytes = 256 * 1024 * 1024, size_t threadCacheSlots = 4);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Pool shared by the download callbacks.
+    static BufferPool& Instance();
+
+    // Returns a slab of at least `size` bytes and stores its real capacity in `capacity`.
+    // Requests above kMaxSlab are allocated directly and freed on release.
+    char* Acquire(size_t size, size_t& capacity);
+    void Release(char* data, size_t capacity);
+    // Frees idle slabs, thread caches included, until at most `keepBytes` stay cached.
+    void Trim(uint64_t keepBytes = 0);
+
+    BufferPoolStats Stats() const;
+
+private:
+    static constexpr size_t kClassCount = 11;
+    using FreeLists = std::array<std::vector<char*>, kClassCount>;
+
+    struct ThreadCache
+    {
+        std::mutex mutex;
+        FreeLists slabs;
+    };
+
+    // Thread-local map from pool id to that thread's cache; hands the caches back when the thread exits.
+    struct LocalCaches;
+
+    ThreadCache& LocalCache();
+    void RetireCache(ThreadCache* cache);
+    static size_t ClassFor(size_t size);
+    bool TakeFrom(std::mutex& mutex, std::vector<char*>& slabs, char*& data);
+
+    const uint64_t m_maxCachedBytes;
+    const size_t m_threadCacheSlots;
+    const uint64_t m_id;
+
+    std::mutex m_mutex;
+    FreeLists m_shared;
+    std::vector<std::unique_ptr<ThreadCache>> m_threadCaches;
+
+    std::atomic<uint64_t> m_cachedBytes{ 0 };
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_trimmedBytes{ 0 };
+};
+
+// Growable byte buffer whose storage comes from a BufferPool and goes back to it on destruction.
+class PooledBuffer
+{
+public:
+    explicit PooledBuffer(BufferPool& pool = BufferPool::Instance());
+    ~PooledBuffer();
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    void Reserve(size_t capacity);
+    void Append(const char* data, size_t size);
+    void Clear();
+
+    const char* Data() const;
+    size_t Size() const;
+    size_t Capacity() const;
+
+private:
+    BufferPool& m_pool;
+    char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+};
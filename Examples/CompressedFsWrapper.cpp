@@ -0,0 +1,533 @@
+#include "CompressedFsWrapper.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+// Frame layout (host byte order):
+//   "DILZ" | uint32 block size | uint64 original size | uint32 block count | uint32 size per block | blocks
+// A block whose size has the high bit set is stored uncompressed.
+//
+// A block is a sequence of: varint literal count, literals, varint (match length - 4), varint match distance.
+// The last sequence has literals only.
+namespace
+{
+    const char kMagic[4] = { 'D', 'I', 'L', 'Z' };
+    const uint32_t kStoredFlag = 0x80000000u;
+    const size_t kMinMatch = 4;
+    const size_t kHashBits = 14;
+    const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+
+    template <typename T>
+    void PutValue(std::string& out, T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    T GetValue(const char* in)
+    {
+        T value;
+        std::memcpy(&value, in, sizeof(value));
+        return value;
+    }
+
+    void PutVarint(std::string& out, size_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    bool GetVarint(const unsigned char*& in, const unsigned char* end, size_t& value)
+    {
+        value = 0;
+        for (int shift = 0; in < end && shift < 64; shift += 7)
+        {
+            const unsigned char byte = *in++;
+            value |= static_cast<size_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Greedy LZ77 with a single-entry hash table, in the spirit of LZ4: fast rather than tight.
+    std::string CompressBlock(const char* src, size_t size)
+    {
+        std::string out;
+        out.reserve(size / 2 + 16);
+        std::vector<size_t> table(size_t(1) << kHashBits, SIZE_MAX);
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (pos + kMinMatch <= size)
+        {
+            const uint32_t hash = (GetValue<uint32_t>(src + pos) * 2654435761u) >> (32 - kHashBits);
+            const size_t candidate = table[hash];
+            table[hash] = pos;
+            if (candidate == SIZE_MAX || std::memcmp(src + candidate, src + pos, kMinMatch) != 0)
+            {
+                ++pos;
+                continue;
+            }
+            size_t length = kMinMatch;
+            while (pos + length < size && src[candidate + length] == src[pos + length])
+            {
+                ++length;
+            }
+            PutVarint(out, pos - anchor);
+            out.append(src + anchor, pos - anchor);
+            PutVarint(out, length - kMinMatch);
+            PutVarint(out, pos - candidate);
+            pos += length;
+            anchor = pos;
+        }
+        PutVarint(out, size - anchor);
+        out.append(src + anchor, size - anchor);
+        return out;
+    }
+
+    // With `dst` null only checks that the block decodes to exactly `dstSize` bytes, so a corrupt block is
+    // rejected before the memory it claims to need is allocated.
+    bool DecompressBlock(const char* src, size_t size, char* dst, size_t dstSize)
+    {
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+        const unsigned char* const end = in + size;
+        size_t out = 0;
+        for (;;)
+        {
+            size_t literals;
+            if (!GetVarint(in, end, literals) || literals > static_cast<size_t>(end - in) || literals > dstSize - out)
+            {
+                return false;
+            }
+            if (dst != nullptr)
+            {
+                std::memcpy(dst + out, in, literals);
+            }
+            in += literals;
+            out += literals;
+            if (in == end)
+            {
+                return out == dstSize;
+            }
+            size_t length;
+            size_t distance;
+            if (!GetVarint(in, end, length) || !GetVarint(in, end, distance))
+            {
+                return false;
+            }
+            length += kMinMatch;
+            if (distance == 0 || distance > out || length > dstSize - out)
+            {
+                return false;
+            }
+            if (dst == nullptr)
+            {
+                out += length;
+                continue;
+            }
+            // Byte by byte on purpose: a match may overlap the bytes it is producing.
+            for (size_t i = 0; i < length; ++i, ++out)
+            {
+                dst[out] = dst[out - distance];
+            }
+        }
+    }
+
+    struct Frame
+    {
+        uint32_t blockSize = 0;
+        uint64_t originalSize = 0;
+        std::vector<uint32_t> sizes;
+        std::vector<size_t> offsets;
+    };
+
+    // Reads the fixed-size part of the header; sizes and offsets are filled by ParseSizeTable.
+    // The block count must match the sizes exactly, which also bounds originalSize below 2^63.
+    bool ParseHeader(const std::string& header, Frame& parsed, uint32_t& count)
+    {
+        if (header.size() < kHeaderSize || std::memcmp(header.data(), kMagic, sizeof(kMagic)) != 0)
+        {
+            return false;
+        }
+        const char* p = header.data() + sizeof(kMagic);
+        parsed.blockSize = GetValue<uint32_t>(p);
+        parsed.originalSize = GetValue<uint64_t>(p + sizeof(uint32_t));
+        count = GetValue<uint32_t>(p + sizeof(uint32_t) + sizeof(uint64_t));
+        return parsed.blockSize != 0 && parsed.blockSize < kStoredFlag
+            && count == parsed.originalSize / parsed.blockSize + (parsed.originalSize % parsed.blockSize != 0 ? 1 : 0);
+    }
+
+    // `table` is the size table following the header. Returns the frame size the table implies.
+    uint64_t ParseSizeTable(const char* table, uint32_t count, Frame& parsed)
+    {
+        uint64_t offset = kHeaderSize + static_cast<uint64_t>(count) * sizeof(uint32_t);
+        parsed.sizes.resize(count);
+        parsed.offsets.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            parsed.sizes[i] = GetValue<uint32_t>(table + i * sizeof(uint32_t));
+            parsed.offsets[i] = static_cast<size_t>(offset);
+            offset += parsed.sizes[i] & ~kStoredFlag;
+        }
+        return offset;
+    }
+
+    bool ParseFrame(const std::string& frame, Frame& parsed)
+    {
+        uint32_t count = 0;
+        if (!ParseHeader(frame, parsed, count) || (frame.size() - kHeaderSize) / sizeof(uint32_t) < count)
+        {
+            return false;
+        }
+        return ParseSizeTable(frame.data() + kHeaderSize, count, parsed) == frame.size();
+    }
+
+    size_t RawSize(const Frame& parsed, size_t index)
+    {
+        const uint64_t begin = static_cast<uint64_t>(index) * parsed.blockSize;
+        return static_cast<size_t>(std::min<uint64_t>(parsed.blockSize, parsed.originalSize - begin));
+    }
+
+    // `src` points at the stored bytes of block `index`. With `dst` null the block is only checked.
+    bool DecodeBlock(const char* src, const Frame& parsed, size_t index, char* dst)
+    {
+        const size_t rawSize = RawSize(parsed, index);
+        const size_t size = parsed.sizes[index] & ~kStoredFlag;
+        if (parsed.sizes[index] & kStoredFlag)
+        {
+            if (size != rawSize)
+            {
+                return false;
+            }
+            if (dst != nullptr)
+            {
+                std::memcpy(dst, src, size);
+            }
+            return true;
+        }
+        return DecompressBlock(src, size, dst, rawSize);
+    }
+
+    // Runs `work(index)` for every block, spread over the available cores once there is more than one block.
+    template <typename Work>
+    void ForEachBlock(size_t count, Work work)
+    {
+        const size_t workers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+        if (workers <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                work(i);
+            }
+            return;
+        }
+        std::vector<std::future<void>> tasks;
+        for (size_t worker = 0; worker < workers; ++worker)
+        {
+            tasks.push_back(std::async(std::launch::async, [worker, workers, count, &work]() {
+                for (size_t i = worker; i < count; i += workers)
+                {
+                    work(i);
+                }
+            }));
+        }
+        for (auto& task : tasks)
+        {
+            task.get();
+        }
+    }
+}
+
+CompressedFsWrapper::CompressedFsWrapper(const FsWrapper& fs, size_t blockSize)
+    : m_fs(fs)
+    , m_blockSize(std::max<size_t>(blockSize, 1))
+{}
+
+void CompressedFsWrapper::SaveToFile(const std::string& data, const std::string& filePath) const
+{
+    m_fs.SaveToFile(Compress(data, m_blockSize), filePath);
+}
+
+bool CompressedFsWrapper::LoadFromFile(const std::string& filePath, std::string& data) const
+{
+    std::string frame;
+    return m_fs.LoadFromFile(filePath, frame) && Decompress(frame, data);
+}
+
+bool CompressedFsWrapper::ReadRange(const std::string& filePath, uint64_t offset, uint64_t length, std::string& data) const
+{
+    // Only the header, the size table and the stored bytes of the covering blocks are read from the file.
+    std::string header;
+    Frame parsed;
+    uint32_t count = 0;
+    if (!m_fs.LoadRange(filePath, 0, kHeaderSize, header) || !ParseHeader(header, parsed, count)
+        || offset > parsed.originalSize)
+    {
+        return false;
+    }
+    length = std::min(length, parsed.originalSize - offset);
+    data.clear();
+    if (length == 0)
+    {
+        return true;
+    }
+    std::string table;
+    if (!m_fs.LoadRange(filePath, kHeaderSize, static_cast<uint64_t>(count) * sizeof(uint32_t), table))
+    {
+        return false;
+    }
+    ParseSizeTable(table.data(), count, parsed);
+    const size_t first = static_cast<size_t>(offset / parsed.blockSize);
+    const size_t last = static_cast<size_t>((offset + length - 1) / parsed.blockSize);
+    const uint64_t storedEnd = parsed.offsets[last] + (parsed.sizes[last] & ~kStoredFlag);
+    std::string stored;
+    if (!m_fs.LoadRange(filePath, parsed.offsets[first], storedEnd - parsed.offsets[first], stored))
+    {
+        return false;
+    }
+    std::string block;
+    for (size_t i = first; i <= last; ++i)
+    {
+        const char* src = stored.data() + (parsed.offsets[i] - parsed.offsets[first]);
+        if (!DecodeBlock(src, parsed, i, nullptr))
+        {
+            return false;
+        }
+        block.resize(RawSize(parsed, i));
+        if (!DecodeBlock(src, parsed, i, &block[0]))
+        {
+            return false;
+        }
+        const uint64_t blockBegin = static_cast<uint64_t>(i) * parsed.blockSize;
+        const uint64_t from = std::max(offset, blockBegin) - blockBegin;
+        const uint64_t to = std::min(offset + length, blockBegin + parsed.blockSize) - blockBegin;
+        data.append(block, static_cast<size_t>(from), static_cast<size_t>(to - from));
+    }
+    return true;
+}
+
+std::string CompressedFsWrapper::Compress(const std::string& data, size_t blockSize)
+{
+    if (blockSize == 0 || blockSize >= kStoredFlag)
+    {
+        throw std::runtime_error("Compress: block size must be between 1 and 2^31 - 1");
+    }
+    const size_t count = data.size() / blockSize + (data.size() % blockSize != 0 ? 1 : 0);
+    if (count > UINT32_MAX)
+    {
+        throw std::runtime_error("Compress: too many blocks, use a larger block size");
+    }
+    std::vector<std::string> blocks(count);
+    std::vector<char> stored(count, 0);
+    ForEachBlock(count, [&](size_t i) {
+        const size_t begin = i * blockSize;
+        const size_t size = std::min(blockSize, data.size() - begin);
+        blocks[i] = CompressBlock(data.data() + begin, size);
+        if (blocks[i].size() >= size)
+        {
+            blocks[i].assign(data, begin, size);
+            stored[i] = 1;
+        }
+    });
+
+    std::string frame(kMagic, sizeof(kMagic));
+    PutValue(frame, static_cast<uint32_t>(blockSize));
+    PutValue(frame, static_cast<uint64_t>(data.size()));
+    PutValue(frame, static_cast<uint32_t>(count));
+    size_t total = frame.size() + count * sizeof(uint32_t);
+    for (size_t i = 0; i < count; ++i)
+    {
+        PutValue(frame, static_cast<uint32_t>(blocks[i].size() | (stored[i] ? kStoredFlag : 0u)));
+        total += blocks[i].size();
+    }
+    frame.reserve(total);
+    for (const auto& block : blocks)
+    {
+        frame += block;
+    }
+    return frame;
+}
+
+bool CompressedFsWrapper::Decompress(const std::string& frame, std::string& data)
+{
+    Frame parsed;
+    if (!ParseFrame(frame, parsed))
+    {
+        return false;
+    }
+    // Every block must decode to its share of originalSize before that much memory is allocated.
+    std::vector<char> ok(parsed.sizes.size(), 0);
+    ForEachBlock(parsed.sizes.size(), [&](size_t i) {
+        ok[i] = DecodeBlock(frame.data() + parsed.offsets[i], parsed, i, nullptr);
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+    {
+        return false;
+    }
+    std::string result(static_cast<size_t>(parsed.originalSize), '\0');
+    ForEachBlock(parsed.sizes.size(), [&](size_t i) {
+        ok[i] = DecodeBlock(frame.data() + parsed.offsets[i], parsed, i, &result[0] + i * parsed.blockSize);
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+    {
+        return false;
+    }
+    data.swap(result);
+    return true;
+}
+
+namespace
+{
+    std::string MakeText(size_t size)
+    {
+        static const char* words[] = { "download ", "file ", "saved ", "to ", "disk ", "from ", "http://localhost/ ", "\n" };
+        std::string text;
+        for (uint32_t i = 0; text.size() < size; ++i)
+        {
+            text += words[(i * 7 + i / 5) % 8];
+        }
+        text.resize(size);
+        return text;
+    }
+
+    class CountingFsWrapper : public FsWrapper
+    {
+    public:
+        virtual bool LoadFromFile(const std::string& filePath, std::string& data) const
+        {
+            const bool loaded = FsWrapper::LoadFromFile(filePath, data);
+            bytesRead += data.size();
+            return loaded;
+        }
+
+        virtual bool LoadRange(const std::string& filePath, uint64_t offset, uint64_t length, std::string& data) const
+        {
+            bytesRead += length;
+            return FsWrapper::LoadRange(filePath, offset, length, data);
+        }
+
+        mutable uint64_t bytesRead = 0;
+    };
+}
+
+TEST(CompressedFsWrapper, SaveToFile)
+{
+    std::string fileName = "C:\\compressed.txt";
+    const std::string text = MakeText(100000);
+    FsWrapper fs;
+    CompressedFsWrapper compressed(fs, 4096);
+    compressed.SaveToFile(text, fileName);
+    EXPECT_LT(std::filesystem::file_size(fileName), text.size() / 4);
+    std::string data;
+    ASSERT_TRUE(compressed.LoadFromFile(fileName, data));
+    EXPECT_EQ(data, text);
+    std::filesystem::remove(fileName);
+}
+
+TEST(CompressedFsWrapper, ReadRangeAcrossBlocks)
+{
+    std::string fileName = "C:\\compressed_range.txt";
+    const std::string text = MakeText(50000);
+    FsWrapper fs;
+    CompressedFsWrapper compressed(fs, 1000);
+    compressed.SaveToFile(text, fileName);
+    std::string data;
+    ASSERT_TRUE(compressed.ReadRange(fileName, 12345, 3000, data));
+    EXPECT_EQ(data, text.substr(12345, 3000));
+    ASSERT_TRUE(compressed.ReadRange(fileName, 49990, 100, data));
+    EXPECT_EQ(data, text.substr(49990));
+    EXPECT_FALSE(compressed.ReadRange(fileName, 50001, 1, data));
+    std::filesystem::remove(fileName);
+}
+
+TEST(CompressedFsWrapper, IncompressibleBlocksAreStored)
+{
+    std::string data;
+    uint32_t state = 12345;
+    for (int i = 0; i < 10000; ++i)
+    {
+        state = state * 1103515245u + 12345u;
+        data.push_back(static_cast<char>(state >> 24));
+    }
+    const std::string frame = CompressedFsWrapper::Compress(data, 4096);
+    EXPECT_LE(frame.size(), data.size() + 64);
+    std::string restored;
+    ASSERT_TRUE(CompressedFsWrapper::Decompress(frame, restored));
+    EXPECT_EQ(restored, data);
+
+    ASSERT_TRUE(CompressedFsWrapper::Decompress(CompressedFsWrapper::Compress("", 4096), restored));
+    EXPECT_EQ(restored, "");
+}
+
+TEST(CompressedFsWrapper, DecompressRejectsCorruptFrame)
+{
+    std::string frame = CompressedFsWrapper::Compress(MakeText(10000), 4096);
+    std::string data;
+    EXPECT_FALSE(CompressedFsWrapper::Decompress(frame.substr(0, frame.size() - 1), data));
+    frame[0] = 'X';
+    EXPECT_FALSE(CompressedFsWrapper::Decompress(frame, data));
+}
+
+TEST(CompressedFsWrapper, CorruptHeaderIsRejectedBeforeAllocating)
+{
+    auto header = [](uint32_t blockSize, uint64_t originalSize, uint32_t count) {
+        std::string frame("DILZ", 4);
+        frame.append(reinterpret_cast<const char*>(&blockSize), sizeof(blockSize));
+        frame.append(reinterpret_cast<const char*>(&originalSize), sizeof(originalSize));
+        frame.append(reinterpret_cast<const char*>(&count), sizeof(count));
+        return frame;
+    };
+    std::string data;
+    // originalSize + blockSize - 1 wraps around to a block count of 0.
+    const std::string wrapped = header(2, ~uint64_t(0), 0);
+    EXPECT_FALSE(CompressedFsWrapper::Decompress(wrapped, data));
+    // A size table of 16 GiB that the file does not contain.
+    const std::string hugeTable = header(1, UINT32_MAX, UINT32_MAX);
+    EXPECT_FALSE(CompressedFsWrapper::Decompress(hugeTable, data));
+    // One compressed block of one byte claiming to expand to 2 GiB.
+    std::string bomb = header(0x7FFFFFFF, 0x7FFFFFFF, 1);
+    const uint32_t blockSize = 1;
+    bomb.append(reinterpret_cast<const char*>(&blockSize), sizeof(blockSize));
+    bomb.push_back('\0');
+    EXPECT_FALSE(CompressedFsWrapper::Decompress(bomb, data));
+
+    std::string fileName = "C:\\compressed_corrupt.txt";
+    FsWrapper fs;
+    CompressedFsWrapper compressed(fs);
+    for (const std::string& frame : { wrapped, hugeTable, bomb })
+    {
+        fs.SaveToFile(frame, fileName);
+        EXPECT_FALSE(compressed.ReadRange(fileName, 0, 100, data));
+        EXPECT_FALSE(compressed.LoadFromFile(fileName, data));
+    }
+    std::filesystem::remove(fileName);
+
+    EXPECT_THROW(CompressedFsWrapper::Compress("FileContent", 0), std::runtime_error);
+    EXPECT_THROW(CompressedFsWrapper::Compress("FileContent", size_t(1) << 31), std::runtime_error);
+}
+
+TEST(CompressedFsWrapper, ReadRangeReadsOnlyCoveringBlocks)
+{
+    std::string fileName = "C:\\compressed_partial.txt";
+    const std::string text = MakeText(200000);
+    CountingFsWrapper fs;
+    CompressedFsWrapper compressed(fs, 1000);
+    compressed.SaveToFile(text, fileName);
+    std::string data;
+    ASSERT_TRUE(compressed.ReadRange(fileName, 100500, 1000, data));
+    EXPECT_EQ(data, text.substr(100500, 1000));
+    // Header and the 200-entry size table, plus two blocks of at most 1000 bytes each.
+    EXPECT_LE(fs.bytesRead, 20u + 200u * 4u + 2000u);
+    std::filesystem::remove(fileName);
+}
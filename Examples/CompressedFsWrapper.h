@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "FsWrapper.h"
+
+// Stores files compressed and decompresses them on load. A file is a frame of independently compressed
+// blocks with a size table in front, so blocks are compressed in parallel and a range can be read
+// without decompressing the blocks before it.
+class CompressedFsWrapper : public IFsWrapper
+{
+public:
+    explicit CompressedFsWrapper(const FsWrapper& fs, size_t blockSize = 256 * 1024);
+
+    virtual void SaveToFile(const std::string& data, const std::string& filePath) const;
+    bool LoadFromFile(const std::string& filePath, std::string& data) const;
+    // Reads and decompresses only the blocks covering [offset, offset + length).
+    bool ReadRange(const std::string& filePath, uint64_t offset, uint64_t length, std::string& data) const;
+
+    static std::string Compress(const std::string& data, size_t blockSize);
+    static bool Decompress(const std::string& frame, std::string& data);
+
+private:
+    const FsWrapper& m_fs;
+    size_t m_blockSize;
+};
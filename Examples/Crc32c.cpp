@@ -0,0 +1,167 @@
+#include "Crc32c.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <gtest/gtest.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE 1
+#define CRC32C_TARGET_SSE42
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE 1
+#define CRC32C_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+
+namespace
+{
+    using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+    Tables MakeTables()
+    {
+        Tables tables{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+            }
+            tables[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            for (size_t slice = 1; slice < tables.size(); ++slice)
+            {
+                const uint32_t prev = tables[slice - 1][i];
+                tables[slice][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+            }
+        }
+        return tables;
+    }
+
+    uint32_t UpdateSoftware(uint32_t crc, const unsigned char* data, size_t size)
+    {
+        static const Tables tables = MakeTables();
+        while (size >= 8)
+        {
+            uint32_t low;
+            uint32_t high;
+            std::memcpy(&low, data, 4);
+            std::memcpy(&high, data + 4, 4);
+            low ^= crc;
+            crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF]
+                ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+                ^ tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF]
+                ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+            data += 8;
+            size -= 8;
+        }
+        while (size-- > 0)
+        {
+            crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xFF];
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_HARDWARE
+    bool HasSse42()
+    {
+        unsigned int regs[4] = {};
+#ifdef _MSC_VER
+        __cpuid(reinterpret_cast<int*>(regs), 1);
+#else
+        __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+        return (regs[2] & (1u << 20)) != 0;
+    }
+
+    CRC32C_TARGET_SSE42 uint32_t UpdateHardware(uint32_t crc, const unsigned char* data, size_t size)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t crc64 = crc;
+        while (size >= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data, 8);
+            crc64 = _mm_crc32_u64(crc64, word);
+            data += 8;
+            size -= 8;
+        }
+        crc = static_cast<uint32_t>(crc64);
+#endif
+        while (size >= 4)
+        {
+            uint32_t word;
+            std::memcpy(&word, data, 4);
+            crc = _mm_crc32_u32(crc, word);
+            data += 4;
+            size -= 4;
+        }
+        while (size-- > 0)
+        {
+            crc = _mm_crc32_u8(crc, *data++);
+        }
+        return crc;
+    }
+#endif
+
+    using UpdateFunction = uint32_t(*)(uint32_t, const unsigned char*, size_t);
+
+    UpdateFunction SelectUpdate()
+    {
+#ifdef CRC32C_HARDWARE
+        if (HasSse42())
+        {
+            return UpdateHardware;
+        }
+#endif
+        return UpdateSoftware;
+    }
+}
+
+void Crc32c::Update(const void* data, size_t size)
+{
+    static const UpdateFunction update = SelectUpdate();
+    m_state = update(m_state, static_cast<const unsigned char*>(data), size);
+}
+
+uint32_t Crc32c::Value() const
+{
+    return m_state ^ 0xFFFFFFFFu;
+}
+
+uint32_t Crc32c::Compute(const void* data, size_t size)
+{
+    Crc32c crc;
+    crc.Update(data, size);
+    return crc.Value();
+}
+
+TEST(Crc32c, ComputeKnownVector)
+{
+    const std::string data = "123456789";
+    EXPECT_EQ(Crc32c::Compute(data.data(), data.size()), 0xE3069283u);
+    EXPECT_EQ(Crc32c::Compute(nullptr, 0), 0u);
+}
+
+TEST(Crc32c, UpdateInChunksMatchesCompute)
+{
+    std::string data;
+    for (int i = 0; i < 1000; ++i)
+    {
+        data.push_back(static_cast<char>(i * 31));
+    }
+    Crc32c crc;
+    for (size_t offset = 0, chunk = 1; offset < data.size(); offset += chunk, chunk += 3)
+    {
+        crc.Update(data.data() + offset, std::min(chunk, data.size() - offset));
+    }
+    EXPECT_EQ(crc.Value(), Crc32c::Compute(data.data(), data.size()));
+    EXPECT_EQ(UpdateSoftware(0xFFFFFFFFu, reinterpret_cast<const unsigned char*>(data.data()), data.size()) ^ 0xFFFFFFFFu,
+              crc.Value());
+}
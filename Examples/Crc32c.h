@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Incremental CRC-32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU has it,
+// otherwise falls back to a slice-by-8 table implementation.
+// Only catches accidental corruption; it is not a cryptographic hash, so digests published
+// for a download (usually SHA-256) have to be checked with Sha256.
+class Crc32c
+{
+public:
+    void Update(const void* data, size_t size);
+    uint32_t Value() const;
+
+    static uint32_t Compute(const void* data, size_t size);
+
+private:
+    uint32_t m_state = 0xFFFFFFFFu;
+};
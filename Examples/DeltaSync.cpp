@@ -0,0 +1,377 @@
+#include "DeltaSync.h"
+#include "Crc32c.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <gmock/gmock.h>
+
+using namespace testing;
+
+namespace
+{
+    // rsync weak checksum: can be moved one byte forward in O(1).
+    class RollingChecksum
+    {
+    public:
+        void Reset(const char* data, size_t size)
+        {
+            m_a = 0;
+            m_b = 0;
+            m_size = static_cast<uint32_t>(size);
+            for (size_t i = 0; i < size; ++i)
+            {
+                const uint32_t byte = static_cast<unsigned char>(data[i]);
+                m_a += byte;
+                m_b += static_cast<uint32_t>(size - i) * byte;
+            }
+        }
+
+        void Roll(char out, char in)
+        {
+            const uint32_t outByte = static_cast<unsigned char>(out);
+            m_a += static_cast<unsigned char>(in) - outByte;
+            m_b += m_a - m_size * outByte;
+        }
+
+        uint32_t Value() const
+        {
+            return (m_a & 0xFFFF) | (m_b << 16);
+        }
+
+    private:
+        uint32_t m_a = 0;
+        uint32_t m_b = 0;
+        uint32_t m_size = 0;
+    };
+
+    BlockSignature SignBlock(const char* data, size_t size)
+    {
+        RollingChecksum rolling;
+        rolling.Reset(data, size);
+        return BlockSignature{ rolling.Value(), Crc32c::Compute(data, size) };
+    }
+
+    template <typename T>
+    void Append(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool Read(const std::string& in, size_t& offset, T& value)
+    {
+        if (in.size() - offset < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, in.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    }
+}
+
+FileSignature ComputeSignature(const std::string& data, uint32_t blockSize)
+{
+    FileSignature signature;
+    signature.blockSize = blockSize;
+    signature.fileSize = data.size();
+    Sha256 digest;
+    digest.Update(data.data(), data.size());
+    signature.digest = digest.Digest();
+    for (size_t offset = 0; offset < data.size(); offset += blockSize)
+    {
+        signature.blocks.push_back(SignBlock(data.data() + offset, std::min<size_t>(blockSize, data.size() - offset)));
+    }
+    return signature;
+}
+
+// Layout: blockSize, fileSize, whole-file SHA-256, block count, then weak and strong checksum per block.
+std::string SerializeSignature(const FileSignature& signature)
+{
+    std::string out;
+    Append(out, signature.blockSize);
+    Append(out, signature.fileSize);
+    Append(out, signature.digest);
+    Append(out, static_cast<uint64_t>(signature.blocks.size()));
+    for (const auto& block : signature.blocks)
+    {
+        Append(out, block.weak);
+        Append(out, block.strong);
+    }
+    return out;
+}
+
+// Nothing is allocated until the block count matches both fileSize and the bytes actually present, so a
+// corrupt signature cannot ask for more memory than it occupies itself.
+bool ParseSignature(const std::string& data, FileSignature& signature)
+{
+    size_t offset = 0;
+    uint64_t count = 0;
+    if (!Read(data, offset, signature.blockSize) || !Read(data, offset, signature.fileSize)
+        || !Read(data, offset, signature.digest) || !Read(data, offset, count) || signature.blockSize == 0
+        || count != signature.fileSize / signature.blockSize + (signature.fileSize % signature.blockSize != 0 ? 1 : 0)
+        || (data.size() - offset) / (2 * sizeof(uint32_t)) < count)
+    {
+        return false;
+    }
+    signature.blocks.resize(static_cast<size_t>(count));
+    for (auto& block : signature.blocks)
+    {
+        if (!Read(data, offset, block.weak) || !Read(data, offset, block.strong))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+DeltaSync::DeltaSync(const IDownloader& downloader, const IFsWrapper& fs)
+    : m_downloader(downloader)
+    , m_fs(fs)
+{}
+
+bool DeltaSync::Sync(const std::string& url, const std::string& signatureUrl, const std::string& filePath,
+                     DeltaReport& report) const
+{
+    report = DeltaReport();
+    const std::string signatureData = m_downloader.DownloadData(signatureUrl);
+    report.bytesTransferred += signatureData.size();
+    FileSignature signature;
+    if (!ParseSignature(signatureData, signature))
+    {
+        return false;
+    }
+    report.fileSize = signature.fileSize;
+
+    std::string local;
+    m_fs.LoadFromFile(filePath, local);
+
+    const size_t blockSize = signature.blockSize;
+    const size_t blockCount = signature.blocks.size();
+    const size_t fullBlocks = static_cast<size_t>(signature.fileSize / blockSize);
+    std::vector<int64_t> source(blockCount, -1);
+
+    std::unordered_multimap<uint32_t, size_t> byWeak;
+    for (size_t i = 0; i < fullBlocks; ++i)
+    {
+        byWeak.emplace(signature.blocks[i].weak, i);
+    }
+
+    // Slide a block-sized window over the local copy; on a match jump a whole block ahead.
+    if (!byWeak.empty() && local.size() >= blockSize)
+    {
+        RollingChecksum rolling;
+        rolling.Reset(local.data(), blockSize);
+        for (size_t pos = 0;;)
+        {
+            bool matched = false;
+            const auto candidates = byWeak.equal_range(rolling.Value());
+            if (candidates.first != candidates.second)
+            {
+                const uint32_t strong = Crc32c::Compute(local.data() + pos, blockSize);
+                for (auto it = candidates.first; it != candidates.second; ++it)
+                {
+                    if (source[it->second] < 0 && signature.blocks[it->second].strong == strong)
+                    {
+                        source[it->second] = static_cast<int64_t>(pos);
+                        matched = true;
+                    }
+                }
+            }
+            if (matched && pos + 2 * blockSize <= local.size())
+            {
+                pos += blockSize;
+                rolling.Reset(local.data() + pos, blockSize);
+            }
+            else if (!matched && pos + blockSize < local.size())
+            {
+                rolling.Roll(local[pos], local[pos + blockSize]);
+                ++pos;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    // Short last block can only be matched at the same offset or at the end of the local copy.
+    if (fullBlocks < blockCount)
+    {
+        const size_t tailSize = static_cast<size_t>(signature.fileSize - fullBlocks * blockSize);
+        const BlockSignature& tail = signature.blocks.back();
+        for (const size_t offset : { fullBlocks * blockSize, local.size() - std::min(local.size(), tailSize) })
+        {
+            if (offset + tailSize <= local.size())
+            {
+                const BlockSignature candidate = SignBlock(local.data() + offset, tailSize);
+                if (candidate.weak == tail.weak && candidate.strong == tail.strong)
+                {
+                    source.back() = static_cast<int64_t>(offset);
+                    break;
+                }
+            }
+        }
+    }
+
+    // fileSize comes from the wire; beyond the local copy the result only grows as ranges actually arrive.
+    std::string result;
+    result.reserve(static_cast<size_t>(std::min<uint64_t>(signature.fileSize, local.size())));
+    for (size_t i = 0; i < blockCount;)
+    {
+        const uint64_t offset = static_cast<uint64_t>(i) * blockSize;
+        if (source[i] >= 0)
+        {
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(blockSize, signature.fileSize - offset));
+            result.append(local, static_cast<size_t>(source[i]), length);
+            ++i;
+            continue;
+        }
+        size_t end = i;
+        while (end < blockCount && source[end] < 0)
+        {
+            ++end;
+        }
+        const uint64_t length = std::min<uint64_t>(static_cast<uint64_t>(end) * blockSize, signature.fileSize) - offset;
+        const std::string range = m_downloader.DownloadRange(url, offset, length);
+        if (range.size() != length)
+        {
+            return false;
+        }
+        report.bytesTransferred += length;
+        ++report.rangesFetched;
+        result += range;
+        i = end;
+    }
+
+    Sha256 digest;
+    digest.Update(result.data(), result.size());
+    if (digest.Digest() != signature.digest)
+    {
+        return false;
+    }
+    m_fs.SaveToFile(result, filePath);
+    return true;
+}
+
+namespace
+{
+    class MockDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
+        MOCK_CONST_METHOD3(DownloadRange, std::string(const std::string&, uint64_t, uint64_t));
+    };
+
+    class MockFsWrapper : public IFsWrapper
+    {
+    public:
+        MOCK_CONST_METHOD2(SaveToFile, void(const std::string&, const std::string&));
+        MOCK_CONST_METHOD2(LoadFromFile, bool(const std::string&, std::string&));
+    };
+
+    std::string MakeData(size_t size)
+    {
+        std::string data(size, '\0');
+        uint32_t state = 12345;
+        for (auto& c : data)
+        {
+            state = state * 1103515245 + 12345;
+            c = static_cast<char>(state >> 16);
+        }
+        return data;
+    }
+
+    class DeltaSyncFixture : public Test
+    {
+    public:
+        void SetUp()
+        {
+            m_remote = MakeData(64 * 16 + 5);
+            ON_CALL(m_downloader, DownloadData("http://localhost/aaa.txt.sig"))
+                .WillByDefault(Return(SerializeSignature(ComputeSignature(m_remote, 16))));
+            ON_CALL(m_downloader, DownloadRange("http://localhost/aaa.txt", _, _))
+                .WillByDefault(Invoke([this](const std::string&, uint64_t offset, uint64_t length) {
+                    return m_remote.substr(static_cast<size_t>(offset), static_cast<size_t>(length));
+                }));
+        }
+
+    protected:
+        std::string m_remote;
+        NiceMock<MockDownloader> m_downloader;
+        MockFsWrapper m_fs;
+    };
+}
+
+TEST(DeltaSync, ParseSignatureRestoresSerializedSignature)
+{
+    const FileSignature signature = ComputeSignature(MakeData(100), 16);
+    FileSignature parsed;
+    ASSERT_TRUE(ParseSignature(SerializeSignature(signature), parsed));
+    EXPECT_EQ(parsed.blockSize, 16u);
+    EXPECT_EQ(parsed.fileSize, 100u);
+    ASSERT_EQ(parsed.blocks.size(), 7u);
+    EXPECT_EQ(parsed.blocks[6].strong, signature.blocks[6].strong);
+    EXPECT_EQ(parsed.digest, signature.digest);
+    EXPECT_FALSE(ParseSignature(SerializeSignature(signature).substr(0, 30), parsed));
+}
+
+TEST(DeltaSync, ParseSignatureRejectsCorruptSizes)
+{
+    FileSignature signature = ComputeSignature(MakeData(100), 16);
+    FileSignature parsed;
+    // Claims 2^61 blocks but carries only 7.
+    signature.fileSize = uint64_t(1) << 61;
+    signature.blockSize = 1;
+    std::string data = SerializeSignature(signature);
+    const uint64_t count = signature.fileSize;
+    std::memcpy(&data[4 + 8 + 32], &count, sizeof(count));
+    EXPECT_FALSE(ParseSignature(data, parsed));
+    // fileSize + blockSize - 1 wraps around to a tiny block count.
+    signature.fileSize = ~uint64_t(0);
+    signature.blockSize = 16;
+    signature.blocks.clear();
+    EXPECT_FALSE(ParseSignature(SerializeSignature(signature), parsed));
+}
+
+TEST_F(DeltaSyncFixture, SyncFetchesOnlyChangedBlocks)
+{
+    std::string local = "XYZ" + m_remote;
+    local[3 + 20 * 16 + 7] ^= 0x55;
+    EXPECT_CALL(m_fs, LoadFromFile("C:\\bbb.txt", _)).WillOnce(DoAll(SetArgReferee<1>(local), Return(true)));
+    EXPECT_CALL(m_downloader, DownloadRange("http://localhost/aaa.txt", 20 * 16, 16));
+    EXPECT_CALL(m_fs, SaveToFile(m_remote, "C:\\bbb.txt"));
+    DeltaSync sync(m_downloader, m_fs);
+    DeltaReport report;
+    ASSERT_TRUE(sync.Sync("http://localhost/aaa.txt", "http://localhost/aaa.txt.sig", "C:\\bbb.txt", report));
+    EXPECT_EQ(report.fileSize, m_remote.size());
+    EXPECT_EQ(report.rangesFetched, 1u);
+    EXPECT_EQ(report.bytesTransferred, SerializeSignature(ComputeSignature(m_remote, 16)).size() + 16);
+}
+
+TEST_F(DeltaSyncFixture, SyncFetchesWholeFileWithoutLocalCopy)
+{
+    EXPECT_CALL(m_fs, LoadFromFile("C:\\bbb.txt", _)).WillOnce(Return(false));
+    EXPECT_CALL(m_downloader, DownloadRange("http://localhost/aaa.txt", 0, m_remote.size()));
+    EXPECT_CALL(m_fs, SaveToFile(m_remote, "C:\\bbb.txt"));
+    DeltaSync sync(m_downloader, m_fs);
+    DeltaReport report;
+    ASSERT_TRUE(sync.Sync("http://localhost/aaa.txt", "http://localhost/aaa.txt.sig", "C:\\bbb.txt", report));
+    EXPECT_EQ(report.rangesFetched, 1u);
+    EXPECT_GT(report.bytesTransferred, m_remote.size());
+}
+
+TEST_F(DeltaSyncFixture, SyncRejectsResultNotMatchingSignature)
+{
+    // Block 3 is missing locally and the file behind `url` changed after its signature was published.
+    std::string local = m_remote;
+    local[3 * 16 + 2] ^= 0x55;
+    m_remote[3 * 16 + 5] ^= 0x55;
+    EXPECT_CALL(m_fs, LoadFromFile("C:\\bbb.txt", _)).WillOnce(DoAll(SetArgReferee<1>(local), Return(true)));
+    EXPECT_CALL(m_fs, SaveToFile(_, _)).Times(0);
+    DeltaSync sync(m_downloader, m_fs);
+    DeltaReport report;
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "http://localhost/aaa.txt.sig", "C:\\bbb.txt", report));
+}
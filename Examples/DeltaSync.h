@@ -0,0 +1,51 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+
+struct BlockSignature
+{
+    uint32_t weak = 0;
+    uint32_t strong = 0;
+};
+
+// Published next to a large file: rolling (weak) and CRC-32C (strong) checksum of every block, plus a
+// SHA-256 of the whole file that the rebuilt copy must match before it is saved.
+struct FileSignature
+{
+    uint32_t blockSize = 0;
+    uint64_t fileSize = 0;
+    std::array<uint8_t, 32> digest{};
+    std::vector<BlockSignature> blocks;
+};
+
+FileSignature ComputeSignature(const std::string& data, uint32_t blockSize);
+std::string SerializeSignature(const FileSignature& signature);
+bool ParseSignature(const std::string& data, FileSignature& signature);
+
+struct DeltaReport
+{
+    uint64_t fileSize = 0;
+    uint64_t bytesTransferred = 0;
+    size_t rangesFetched = 0;
+};
+
+// rsync-style update: blocks of the remote file found anywhere in the local copy are reused,
+// only the rest is fetched with Range requests. Sync fails without writing if the result does not match
+// the signature's digest, e.g. because the signature is stale. The local copy and the rebuilt file are
+// both held in memory.
+class DeltaSync
+{
+public:
+    DeltaSync(const IDownloader& downloader, const IFsWrapper& fs);
+
+    bool Sync(const std::string& url, const std::string& signatureUrl, const std::string& filePath, DeltaReport& report) const;
+
+private:
+    const IDownloader& m_downloader;
+    const IFsWrapper& m_fs;
+};
@@ -0,0 +1,495 @@
+#include "DownloadPipeline.h"
+#include "InMemoryFsWrapper.h"
+#include "LoopbackDownloader.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <gtest/gtest.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Chunk
+    {
+        size_t file = 0;
+        std::string data;
+        // Marks the end of `file`; with `file` past the last index it ends the whole stream.
+        bool end = false;
+    };
+
+    // Lets one side of the ring sleep until the other side makes progress. The waiter announces itself before
+    // its last check, so progress made after that check always rings; with nobody waiting, Ring is one load.
+    class Doorbell
+    {
+    public:
+        template <typename Ready>
+        void Wait(Ready ready)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_bell.wait(lock, ready);
+            m_waiting.store(false, std::memory_order_relaxed);
+        }
+
+        void Ring()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_waiting.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bell.notify_one();
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_bell;
+        std::atomic<bool> m_waiting{ false };
+    };
+
+    double Ratio(std::chrono::nanoseconds part, std::chrono::nanoseconds whole)
+    {
+        return whole.count() > 0 ? static_cast<double>(part.count()) / whole.count() : 0.0;
+    }
+}
+
+double PipelineStats::NetworkUtilization() const
+{
+    return Ratio(networkBusy, elapsed);
+}
+
+double PipelineStats::WriterUtilization() const
+{
+    return Ratio(writerBusy, elapsed);
+}
+
+DownloadPipeline::DownloadPipeline(const IDownloader& downloader, const IFsWrapper& fs, size_t ringCapacity)
+    : m_downloader(downloader)
+    , m_fs(fs)
+    , m_ringCapacity(ringCapacity)
+{}
+
+void DownloadPipeline::DownloadFiles(const std::vector<PipelineFile>& files)
+{
+    SpscRing<Chunk> ring(m_ringCapacity);
+    // Emptied chunk buffers, from the writer back to the network stage.
+    SpscRing<std::string> spare(m_ringCapacity);
+    Doorbell notEmpty;
+    Doorbell notFull;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> writerFailed{ false };
+    std::exception_ptr writerError;
+    std::chrono::nanoseconds writerBusy{ 0 };
+    std::chrono::nanoseconds networkStalled{ 0 };
+    const auto start = Clock::now();
+
+    std::thread writer([&]() {
+        try
+        {
+            std::string data;
+            Chunk chunk;
+            for (;;)
+            {
+                bool popped = ring.TryPop(chunk);
+                if (!popped)
+                {
+                    notEmpty.Wait([&]() { return (popped = ring.TryPop(chunk)) || stopping; });
+                    if (!popped)
+                    {
+                        return;
+                    }
+                }
+                notFull.Ring();
+                if (chunk.end && chunk.file == files.size())
+                {
+                    return;
+                }
+                const auto busyStart = Clock::now();
+                if (chunk.end)
+                {
+                    // Keeps its capacity, so after the largest file the buffer stops growing.
+                    m_fs.SaveToFile(data, files[chunk.file].filePath);
+                    data.clear();
+                }
+                else
+                {
+                    data += chunk.data;
+                    chunk.data.clear();
+                    spare.TryPush(std::move(chunk.data));
+                }
+                writerBusy += Clock::now() - busyStart;
+            }
+        }
+        catch (...)
+        {
+            writerError = std::current_exception();
+            writerFailed = true;
+            notFull.Ring();
+        }
+    });
+
+    // Throws once the writer has failed; the real Downloader turns that into an aborted transfer.
+    auto push = [&](Chunk&& chunk) {
+        bool pushed = !writerFailed && ring.TryPush(std::move(chunk));
+        if (!pushed && !writerFailed)
+        {
+            const auto stallStart = Clock::now();
+            notFull.Wait([&]() { return (pushed = ring.TryPush(std::move(chunk))) || writerFailed; });
+            networkStalled += Clock::now() - stallStart;
+        }
+        if (!pushed)
+        {
+            throw std::runtime_error("Pipeline writer stopped");
+        }
+        notEmpty.Ring();
+    };
+
+    std::chrono::steady_clock::time_point networkDone;
+    try
+    {
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            m_downloader.DownloadChunks(files[i].url, [this, i, &push, &spare](const char* data, size_t size) {
+                ++m_stats.chunks;
+                m_stats.bytes += size;
+                std::string buffer;
+                spare.TryPop(buffer);
+                buffer.assign(data, size);
+                push(Chunk{ i, std::move(buffer), false });
+            });
+            push(Chunk{ i, std::string(), true });
+        }
+        networkDone = Clock::now();
+        push(Chunk{ files.size(), std::string(), true });
+    }
+    catch (...)
+    {
+        stopping = true;
+        notEmpty.Ring();
+        writer.join();
+        if (writerError)
+        {
+            std::rethrow_exception(writerError);
+        }
+        throw;
+    }
+    writer.join();
+    if (writerError)
+    {
+        std::rethrow_exception(writerError);
+    }
+
+    m_stats.elapsed += Clock::now() - start;
+    m_stats.networkBusy += networkDone - start - networkStalled;
+    m_stats.networkStalled += networkStalled;
+    m_stats.writerBusy += writerBusy;
+}
+
+const PipelineStats& DownloadPipeline::Stats() const
+{
+    return m_stats;
+}
+
+namespace
+{
+    // Number of chunks the network stage has been handed so far, for tests that check how far it got.
+    class Progress
+    {
+    public:
+        void Add()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_chunks;
+            }
+            m_changed.notify_all();
+        }
+
+        size_t Chunks() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_chunks;
+        }
+
+        // False only if `chunks` are not reached within a generous timeout, i.e. the network stage is blocked.
+        bool WaitFor(size_t chunks) const
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            return m_changed.wait_for(lock, std::chrono::seconds(10), [&]() { return m_chunks >= chunks; });
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        mutable std::condition_variable m_changed;
+        size_t m_chunks = 0;
+    };
+
+    // Serves "<url>:<index>" chunks, sleeping before each one as if waiting on the socket.
+    class FakeChunkDownloader : public IDownloader
+    {
+    public:
+        FakeChunkDownloader(size_t chunks, std::chrono::milliseconds delay, Progress* progress = nullptr)
+            : m_chunks(chunks)
+            , m_delay(delay)
+            , m_progress(progress)
+        {}
+
+        using IDownloader::DownloadData;
+        virtual std::string DownloadData(const std::string& url) const
+        {
+            std::string data;
+            DownloadChunks(url, [&data](const char* chunk, size_t size) { data.append(chunk, size); });
+            return data;
+        }
+
+        virtual void DownloadChunks(const std::string& url, const ChunkSink& sink) const
+        {
+            for (size_t i = 0; i < m_chunks; ++i)
+            {
+                std::this_thread::sleep_for(m_delay);
+                const std::string chunk = url + ":" + std::to_string(i) + ";";
+                if (m_progress != nullptr)
+                {
+                    m_progress->Add();
+                }
+                sink(chunk.data(), chunk.size());
+            }
+        }
+
+    private:
+        size_t m_chunks;
+        std::chrono::milliseconds m_delay;
+        Progress* m_progress;
+    };
+
+    // Like Downloader on a reset connection: part of the body arrives, then the transfer throws.
+    class FailingChunkDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        virtual std::string DownloadData(const std::string&) const
+        {
+            throw std::runtime_error("connection reset");
+        }
+
+        virtual void DownloadChunks(const std::string& url, const ChunkSink& sink) const
+        {
+            sink(url.data(), url.size());
+            if (url.find("bbb") != std::string::npos)
+            {
+                throw std::runtime_error("connection reset");
+            }
+        }
+    };
+
+    class FailingFsWrapper : public InMemoryFsWrapper
+    {
+    public:
+        virtual void SaveToFile(const std::string&, const std::string& filePath) const
+        {
+            throw std::runtime_error("disk full: " + filePath);
+        }
+    };
+
+    // Saving file k waits until the network stage has handed out a chunk of file k + 1, which only happens
+    // if receiving goes on while the writer is busy; a serial implementation would time out here.
+    class OverlapFsWrapper : public InMemoryFsWrapper
+    {
+    public:
+        OverlapFsWrapper(const Progress& progress, size_t chunksPerFile, size_t files)
+            : m_progress(progress)
+            , m_chunksPerFile(chunksPerFile)
+            , m_files(files)
+        {}
+
+        virtual void SaveToFile(const std::string& data, const std::string& filePath) const
+        {
+            const size_t file = FileCount();
+            if (file + 1 < m_files && !m_progress.WaitFor((file + 1) * m_chunksPerFile + 1))
+            {
+                ++serialized;
+            }
+            InMemoryFsWrapper::SaveToFile(data, filePath);
+        }
+
+        mutable size_t serialized = 0;
+
+    private:
+        const Progress& m_progress;
+        size_t m_chunksPerFile;
+        size_t m_files;
+    };
+
+    // Slow disk that records how many chunks the network stage had been handed when each save finished.
+    class SlowFsWrapper : public InMemoryFsWrapper
+    {
+    public:
+        SlowFsWrapper(std::chrono::milliseconds delay, const Progress& progress)
+            : m_delay(delay)
+            , m_progress(progress)
+        {}
+
+        virtual void SaveToFile(const std::string& data, const std::string& filePath) const
+        {
+            std::this_thread::sleep_for(m_delay);
+            chunksAtSave.push_back(m_progress.Chunks());
+            InMemoryFsWrapper::SaveToFile(data, filePath);
+        }
+
+        mutable std::vector<size_t> chunksAtSave;
+
+    private:
+        std::chrono::milliseconds m_delay;
+        const Progress& m_progress;
+    };
+}
+
+TEST(SpscRing, TryPushFailsWhenFull)
+{
+    SpscRing<int> ring(3);
+    EXPECT_EQ(ring.Capacity(), 4u);
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(ring.TryPush(int(i)));
+    }
+    EXPECT_FALSE(ring.TryPush(4));
+    int value = -1;
+    ASSERT_TRUE(ring.TryPop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(ring.TryPush(4));
+}
+
+TEST(SpscRing, TransfersInOrderBetweenThreads)
+{
+    SpscRing<int> ring(16);
+    const int count = 100000;
+    std::thread producer([&ring]() {
+        for (int i = 0; i < count; ++i)
+        {
+            while (!ring.TryPush(int(i)))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int expected = 0;
+    while (expected < count)
+    {
+        int value;
+        if (!ring.TryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(value, expected);
+        ++expected;
+    }
+    producer.join();
+    int value;
+    EXPECT_FALSE(ring.TryPop(value));
+}
+
+TEST(DownloadPipeline, DownloadFiles)
+{
+    FakeChunkDownloader downloader(3, std::chrono::milliseconds(0));
+    InMemoryFsWrapper fs;
+    DownloadPipeline pipeline(downloader, fs);
+    pipeline.DownloadFiles({ { "http://localhost/aaa.txt", "C:\\aaa.txt" }, { "http://localhost/bbb.txt", "C:\\bbb.txt" } });
+
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\aaa.txt", data));
+    EXPECT_EQ(data, "http://localhost/aaa.txt:0;http://localhost/aaa.txt:1;http://localhost/aaa.txt:2;");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "http://localhost/bbb.txt:0;http://localhost/bbb.txt:1;http://localhost/bbb.txt:2;");
+    EXPECT_EQ(pipeline.Stats().chunks, 6u);
+    EXPECT_EQ(pipeline.Stats().bytes, 2 * data.size());
+}
+
+TEST(DownloadPipeline, DownloadFilesWithWholeBodyDownloader)
+{
+    LoopbackDownloader downloader([]() { return size_t(1000); });
+    InMemoryFsWrapper fs;
+    DownloadPipeline pipeline(downloader, fs);
+    pipeline.DownloadFiles({ { "http://localhost/aaa.txt", "C:\\aaa.txt" } });
+
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\aaa.txt", data));
+    EXPECT_EQ(data, downloader.DownloadData("http://localhost/aaa.txt"));
+    EXPECT_EQ(pipeline.Stats().chunks, 1u);
+}
+
+TEST(DownloadPipeline, DiskWritesOverlapNetwork)
+{
+    Progress progress;
+    FakeChunkDownloader downloader(4, std::chrono::milliseconds(0), &progress);
+    OverlapFsWrapper fs(progress, 4, 5);
+    DownloadPipeline pipeline(downloader, fs);
+    std::vector<PipelineFile> files;
+    for (int i = 0; i < 5; ++i)
+    {
+        files.push_back({ "http://localhost/" + std::to_string(i), "C:\\" + std::to_string(i) + ".txt" });
+    }
+    pipeline.DownloadFiles(files);
+
+    EXPECT_EQ(fs.FileCount(), 5u);
+    EXPECT_EQ(fs.serialized, 0u);
+}
+
+TEST(DownloadPipeline, FullRingHoldsBackNetwork)
+{
+    Progress progress;
+    FakeChunkDownloader downloader(8, std::chrono::milliseconds(0), &progress);
+    SlowFsWrapper fs(std::chrono::milliseconds(30), progress);
+    DownloadPipeline pipeline(downloader, fs, 2);
+    pipeline.DownloadFiles({ { "http://localhost/aaa.txt", "C:\\aaa.txt" }, { "http://localhost/bbb.txt", "C:\\bbb.txt" } });
+
+    EXPECT_EQ(fs.FileCount(), 2u);
+    // While the first file is saved the network stage can be at most a full ring (2 slots) plus the chunk
+    // it is blocked on ahead of it; without backpressure it would have handed out all 16 chunks.
+    ASSERT_EQ(fs.chunksAtSave.size(), 2u);
+    EXPECT_LE(fs.chunksAtSave[0], 8u + 2u + 1u);
+    EXPECT_EQ(fs.chunksAtSave[1], 16u);
+}
+
+TEST(DownloadPipeline, DownloaderErrorReachesCaller)
+{
+    FailingChunkDownloader downloader;
+    InMemoryFsWrapper fs;
+    DownloadPipeline pipeline(downloader, fs);
+    EXPECT_THROW(pipeline.DownloadFiles({ { "http://localhost/aaa.txt", "C:\\aaa.txt" },
+                                          { "http://localhost/bbb.txt", "C:\\bbb.txt" },
+                                          { "http://localhost/ccc.txt", "C:\\ccc.txt" } }),
+                 std::runtime_error);
+    // Files before the failure are complete; the truncated one is dropped and nothing after it is fetched.
+    std::string data;
+    EXPECT_TRUE(fs.LoadFromFile("C:\\aaa.txt", data));
+    EXPECT_FALSE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(fs.FileCount(), 1u);
+}
+
+TEST(DownloadPipeline, WriterErrorReachesCaller)
+{
+    FakeChunkDownloader downloader(50, std::chrono::milliseconds(0));
+    FailingFsWrapper fs;
+    DownloadPipeline pipeline(downloader, fs, 2);
+    std::vector<PipelineFile> files;
+    for (int i = 0; i < 20; ++i)
+    {
+        files.push_back({ "http://localhost/" + std::to_string(i), "C:\\" + std::to_string(i) + ".txt" });
+    }
+    try
+    {
+        pipeline.DownloadFiles(files);
+        FAIL();
+    }
+    catch (const std::runtime_error& e)
+    {
+        EXPECT_STREQ(e.what(), "disk full: C:\\0.txt");
+    }
+}
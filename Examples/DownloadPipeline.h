@@ -0,0 +1,53 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+
+struct PipelineFile
+{
+    std::string url;
+    std::string filePath;
+};
+
+struct PipelineStats
+{
+    std::chrono::nanoseconds elapsed{ 0 };
+    // Time spent receiving, not counting waits for space in the ring.
+    std::chrono::nanoseconds networkBusy{ 0 };
+    // Time the network stage waited because the writer fell behind.
+    std::chrono::nanoseconds networkStalled{ 0 };
+    std::chrono::nanoseconds writerBusy{ 0 };
+    uint64_t chunks = 0;
+    uint64_t bytes = 0;
+
+    double NetworkUtilization() const;
+    double WriterUtilization() const;
+};
+
+// Two-stage download: curl's write callback pushes received chunks into a bounded SPSC ring
+// and a dedicated writer thread drains it into IFsWrapper, so disk writes of one file overlap
+// receiving the next. When the ring is full the callback waits, which stops reading from the socket;
+// when it is empty the writer sleeps. Both waits block rather than spin.
+// Chunk buffers go back to the network stage through a second ring and are reused, so steady state
+// allocates nothing per chunk. IFsWrapper saves whole files, so the writer still collects each file
+// before saving it: memory is the ring plus the largest file, not the ring alone.
+class DownloadPipeline
+{
+public:
+    DownloadPipeline(const IDownloader& downloader, const IFsWrapper& fs, size_t ringCapacity = 64);
+
+    // Network stage runs on the calling thread; returns once every file has been saved. An exception from
+    // either stage stops both and is rethrown here, the writer's first.
+    void DownloadFiles(const std::vector<PipelineFile>& files);
+    const PipelineStats& Stats() const;
+
+private:
+    const IDownloader& m_downloader;
+    const IFsWrapper& m_fs;
+    size_t m_ringCapacity;
+    PipelineStats m_stats;
+};
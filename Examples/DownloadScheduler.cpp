@@ -0,0 +1,249 @@
+#include "DownloadScheduler.h"
+#include <stdexcept>
+#include <gtest/gtest.h>
+
+#include "InMemoryFsWrapper.h"
+#include "LoopbackDownloader.h"
+
+void LatencyHistogram::Record(std::chrono::microseconds latency)
+{
+    size_t bucket = 0;
+    for (auto value = latency.count(); value > 1 && bucket + 1 < m_buckets.size(); value >>= 1)
+    {
+        ++bucket;
+    }
+    ++m_buckets[bucket];
+    ++m_count;
+}
+
+std::chrono::microseconds LatencyHistogram::Percentile(double quantile) const
+{
+    const uint64_t rank = static_cast<uint64_t>(quantile * m_count);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < m_buckets.size(); ++bucket)
+    {
+        seen += m_buckets[bucket];
+        if (seen > rank || seen == m_count)
+        {
+            return std::chrono::microseconds(int64_t(1) << (bucket + 1));
+        }
+    }
+    return std::chrono::microseconds(0);
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+    return m_count;
+}
+
+bool DownloadScheduler::LaterDeadline::operator()(const Job& left, const Job& right) const
+{
+    if (left.deadline != right.deadline)
+    {
+        return left.deadline > right.deadline;
+    }
+    return left.sequence > right.sequence;
+}
+
+DownloadScheduler::DownloadScheduler(const IDownloader& downloader, const IFsWrapper& fs, size_t workers,
+                                     size_t reservedForInteractive)
+    : m_downloader(downloader)
+    , m_fs(fs)
+    , m_bulkWorkers(workers > reservedForInteractive ? workers - reservedForInteractive : 0)
+{
+    for (size_t i = 0; i < workers; ++i)
+    {
+        m_workers.emplace_back(&DownloadScheduler::WorkerLoop, this);
+    }
+}
+
+DownloadScheduler::~DownloadScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_workAvailable.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void DownloadScheduler::Schedule(const std::string& url, const std::string& filePath, DownloadPriority priority,
+                                 Clock::time_point deadline)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queues[static_cast<size_t>(priority)].push(Job{ url, filePath, Clock::now(), deadline, m_sequence++ });
+    }
+    m_workAvailable.notify_one();
+}
+
+void DownloadScheduler::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() {
+        return m_running == 0 && m_queues[0].empty() && (m_queues[1].empty() || m_bulkWorkers == 0);
+    });
+}
+
+SchedulerClassStats DownloadScheduler::Stats(DownloadPriority priority) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats[static_cast<size_t>(priority)];
+}
+
+bool DownloadScheduler::CanRunBulk() const
+{
+    return !m_queues[1].empty() && m_runningBulk < m_bulkWorkers;
+}
+
+void DownloadScheduler::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_workAvailable.wait(lock, [this]() { return m_stop || !m_queues[0].empty() || CanRunBulk(); });
+        if (m_stop)
+        {
+            return;
+        }
+        const size_t priority = m_queues[0].empty() ? 1 : 0;
+        Job job = m_queues[priority].top();
+        m_queues[priority].pop();
+        if (Clock::now() > job.deadline)
+        {
+            ++m_stats[priority].expired;
+        }
+        else
+        {
+            ++m_running;
+            m_runningBulk += priority;
+            lock.unlock();
+            // A failing job must not take the worker thread (and with it the process) down.
+            bool succeeded = true;
+            try
+            {
+                const auto& downloadedData = m_downloader.DownloadData(job.url);
+                m_fs.SaveToFile(downloadedData, job.filePath);
+            }
+            catch (...)
+            {
+                succeeded = false;
+            }
+            const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - job.scheduled);
+            lock.lock();
+            --m_running;
+            m_runningBulk -= priority;
+            if (succeeded)
+            {
+                ++m_stats[priority].completed;
+                m_stats[priority].latency.Record(latency);
+            }
+            else
+            {
+                ++m_stats[priority].failed;
+            }
+            if (priority == 1)
+            {
+                m_workAvailable.notify_one();
+            }
+        }
+        m_idle.notify_all();
+    }
+}
+
+TEST(LatencyHistogram, PercentileReportsBucketUpperBound)
+{
+    LatencyHistogram histogram;
+    histogram.Record(std::chrono::microseconds(3));
+    histogram.Record(std::chrono::microseconds(1000));
+    EXPECT_EQ(histogram.Percentile(0.0), std::chrono::microseconds(4));
+    EXPECT_EQ(histogram.Percentile(0.99), std::chrono::microseconds(1024));
+}
+
+TEST(DownloadScheduler, ScheduleRunsAllJobs)
+{
+    LoopbackDownloader downloader([]() { return size_t(64); });
+    InMemoryFsWrapper fs;
+    DownloadScheduler scheduler(downloader, fs, 4, 1);
+    for (int i = 0; i < 100; ++i)
+    {
+        scheduler.Schedule("http://localhost/aaa.txt", "C:\\" + std::to_string(i) + ".txt",
+                           i % 2 ? DownloadPriority::Bulk : DownloadPriority::Interactive);
+    }
+    scheduler.WaitIdle();
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Interactive).completed, 50u);
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Bulk).completed, 50u);
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Bulk).latency.Count(), 50u);
+    EXPECT_EQ(fs.FileCount(), 100u);
+}
+
+TEST(DownloadScheduler, ScheduleDropsExpiredJobs)
+{
+    LoopbackDownloader downloader([]() { return size_t(64); });
+    InMemoryFsWrapper fs;
+    DownloadScheduler scheduler(downloader, fs, 1, 0);
+    scheduler.Schedule("http://localhost/aaa.txt", "C:\\bbb.txt", DownloadPriority::Interactive,
+                       DownloadScheduler::Clock::now() - std::chrono::milliseconds(1));
+    scheduler.WaitIdle();
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Interactive).expired, 1u);
+    EXPECT_EQ(downloader.RequestCount(), 0u);
+    EXPECT_EQ(fs.FileCount(), 0u);
+}
+
+TEST(DownloadScheduler, InteractiveJobsAreNotDelayedByBulkBacklog)
+{
+    LoopbackDownloader downloader([]() { return size_t(64); }, []() { return std::chrono::milliseconds(5); });
+    InMemoryFsWrapper fs;
+    DownloadScheduler scheduler(downloader, fs, 2, 1);
+    for (int i = 0; i < 40; ++i)
+    {
+        scheduler.Schedule("http://localhost/bulk.txt", "C:\\bulk" + std::to_string(i) + ".txt", DownloadPriority::Bulk);
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        scheduler.Schedule("http://localhost/aaa.txt", "C:\\bbb" + std::to_string(i) + ".txt", DownloadPriority::Interactive);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scheduler.WaitIdle();
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Interactive).completed, 5u);
+    EXPECT_LT(scheduler.Stats(DownloadPriority::Interactive).latency.Percentile(0.99), std::chrono::milliseconds(50));
+    EXPECT_GT(scheduler.Stats(DownloadPriority::Bulk).latency.Percentile(0.99), std::chrono::milliseconds(100));
+}
+
+namespace
+{
+    class FailingDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        virtual std::string DownloadData(const std::string& url) const
+        {
+            if (url.find("bad") != std::string::npos)
+            {
+                throw std::runtime_error("download failed");
+            }
+            return "FileContent";
+        }
+    };
+}
+
+TEST(DownloadScheduler, FailingJobsAreCountedAndDoNotStopWorkers)
+{
+    FailingDownloader downloader;
+    InMemoryFsWrapper fs;
+    DownloadScheduler scheduler(downloader, fs, 2, 1);
+    for (int i = 0; i < 10; ++i)
+    {
+        scheduler.Schedule(i % 2 ? "http://localhost/bad.txt" : "http://localhost/aaa.txt",
+                           "C:\\" + std::to_string(i) + ".txt", i < 5 ? DownloadPriority::Interactive : DownloadPriority::Bulk);
+    }
+    scheduler.WaitIdle();
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Interactive).completed, 3u);
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Interactive).failed, 2u);
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Bulk).completed, 2u);
+    EXPECT_EQ(scheduler.Stats(DownloadPriority::Bulk).failed, 3u);
+    EXPECT_EQ(fs.FileCount(), 5u);
+}
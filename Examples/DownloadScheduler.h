@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+
+enum class DownloadPriority
+{
+    Interactive,
+    Bulk
+};
+
+// Power-of-two buckets of microseconds, cheap enough to update on every request.
+class LatencyHistogram
+{
+public:
+    void Record(std::chrono::microseconds latency);
+    // Upper bound of the bucket holding the given quantile; bucket b holds [2^b, 2^(b+1)) microseconds.
+    std::chrono::microseconds Percentile(double quantile) const;
+    uint64_t Count() const;
+
+private:
+    std::array<uint64_t, 40> m_buckets{};
+    uint64_t m_count = 0;
+};
+
+struct SchedulerClassStats
+{
+    size_t completed = 0;
+    size_t expired = 0;
+    // Jobs whose download or save threw; they are not retried.
+    size_t failed = 0;
+    LatencyHistogram latency;
+};
+
+// Runs DownloadFile jobs on a fixed set of workers. Interactive jobs always go first and
+// `reservedForInteractive` workers never take bulk jobs. Jobs are ordered by deadline within a class
+// and dropped without being started once their deadline has passed.
+class DownloadScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    DownloadScheduler(const IDownloader& downloader, const IFsWrapper& fs, size_t workers, size_t reservedForInteractive);
+    ~DownloadScheduler();
+
+    void Schedule(const std::string& url, const std::string& filePath, DownloadPriority priority,
+                  Clock::time_point deadline = Clock::time_point::max());
+    void WaitIdle();
+    SchedulerClassStats Stats(DownloadPriority priority) const;
+
+private:
+    struct Job
+    {
+        std::string url;
+        std::string filePath;
+        Clock::time_point scheduled;
+        Clock::time_point deadline;
+        uint64_t sequence;
+    };
+
+    struct LaterDeadline
+    {
+        bool operator()(const Job& left, const Job& right) const;
+    };
+
+    using JobQueue = std::priority_queue<Job, std::vector<Job>, LaterDeadline>;
+
+    void WorkerLoop();
+    bool CanRunBulk() const;
+
+    const IDownloader& m_downloader;
+    const IFsWrapper& m_fs;
+    const size_t m_bulkWorkers;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_idle;
+    std::array<JobQueue, 2> m_queues;
+    std::array<SchedulerClassStats, 2> m_stats;
+    size_t m_runningBulk = 0;
+    size_t m_running = 0;
+    uint64_t m_sequence = 0;
+    bool m_stop = false;
+    std::vector<std::thread> m_workers;
+};
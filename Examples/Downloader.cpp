@@ -1,40 +1,423 @@
 #include "Downloader.h"
-#include <sstream>
+#include "BufferPool.h"
+#include "Crc32c.h"
+#include "MemoryGovernor.h"
+#include "Sha256.h"
+#include <algorithm>
 #include <curl/curl.h>
+#include <exception>
+#include <stdexcept>
 #include <gtest/gtest.h>
 
 namespace
 {
+    struct WriteContext
+    {
+        CURL* curl;
+        std::string* data;
+        Crc32c* checksum;
+        Sha256* digest;
+        MemoryGovernor* governor;
+        uint64_t reserved;
+        const ChunkSink* sink;
+        PooledBuffer* buffer;
+        bool pooled;
+        // What the callback caught, so the caller can rethrow it once curl has returned.
+        std::exception_ptr error;
+    };
+
+    // Content-Length is only a hint from the server; pre-sizing beyond this is left to normal growth.
+    const uint64_t kMaxPresize = 64 * 1024 * 1024;
+
+    // Body is appended straight into the string that DownloadData returns, so it is never copied after receiving.
+    // Without a Content-Length the string would be regrown geometrically, so the body is collected in a
+    // pooled slab instead and copied once into an exactly sized string at the end.
+    // With a governor, the first chunk waits until the whole Content-Length fits into the budget, and any growth
+    // beyond it (all of a body without Content-Length) waits chunk by chunk; while it waits curl does not read
+    // from the socket, so the sender is throttled by TCP flow control.
     size_t WriteData(void* contents, size_t size, size_t nmemb, void* userp) {
         const size_t realsize = size * nmemb;
-        std::ostream* const stream = static_cast<std::ostream*>(userp);
-        if (stream != nullptr)
+        WriteContext* const context = static_cast<WriteContext*>(userp);
+        // Nothing may propagate through curl's C frames; returning a short count aborts the transfer instead and
+        // the exception is kept for the caller.
+        try
+        {
+            if (context->data != nullptr)
+            {
+                const uint64_t received = context->data->size() + context->buffer->Size();
+                if (received == 0 && !context->pooled)
+                {
+                    double contentLength = -1;
+                    if (curl_easy_getinfo(context->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &contentLength) == CURLE_OK
+                        && contentLength > 0)
+                    {
+                        const uint64_t expected = std::min(static_cast<uint64_t>(contentLength), kMaxPresize);
+                        if (context->governor != nullptr && context->reserved == 0)
+                        {
+                            context->governor->Reserve(expected);
+                            context->reserved = expected;
+                        }
+                        context->data->reserve(static_cast<size_t>(expected));
+                    }
+                    else
+                    {
+                        context->pooled = true;
+                    }
+                }
+                const uint64_t needed = received + realsize;
+                if (context->governor != nullptr && needed > context->reserved)
+                {
+                    context->governor->Charge(needed - context->reserved, context->reserved);
+                    context->reserved = needed;
+                }
+                if (context->pooled)
+                {
+                    context->buffer->Append(static_cast<const char*>(contents), realsize);
+                }
+                else
+                {
+                    context->data->append(static_cast<const char*>(contents), realsize);
+                }
+            }
+            if (context->checksum != nullptr)
+            {
+                context->checksum->Update(contents, realsize);
+            }
+            if (context->digest != nullptr)
+            {
+                context->digest->Update(contents, realsize);
+            }
+            if (context->sink != nullptr)
+            {
+                (*context->sink)(static_cast<const char*>(contents), realsize);
+            }
+            return realsize;
+        }
+        catch (...)
         {
-            stream->write(static_cast<const char*>(contents), realsize);
+            context->error = std::current_exception();
+            return 0;
+        }
+    }
+
+    class CurlHandle
+    {
+    public:
+        CurlHandle() : m_curl(curl_easy_init()) {}
+        ~CurlHandle()
+        {
+            if (m_curl) {
+                curl_easy_cleanup(m_curl);
+            }
+        }
+        CurlHandle(const CurlHandle&) = delete;
+        CurlHandle& operator=(const CurlHandle&) = delete;
+
+        CURL* Get() const { return m_curl; }
+
+    private:
+        CURL* m_curl;
+    };
+
+    // Easy handle owns curl's receive buffer and connection cache, so keeping one per thread
+    // lets consecutive downloads reuse them instead of allocating and freeing them on every call.
+    CURL* AcquireCurl()
+    {
+        thread_local CurlHandle handle;
+        if (handle.Get()) {
+            curl_easy_reset(handle.Get());
+        }
+        return handle.Get();
+    }
+
+    std::string PerformDownload(CURL* curl, const char* url, Crc32c* checksum, Sha256* digest, MemoryGovernor* governor,
+                                CURLcode* result = nullptr)
+    {
+        std::string data;
+        CURLcode res = CURLE_FAILED_INIT;
+
+        if (curl) {
+            PooledBuffer buffer;
+            WriteContext context{ curl, &data, checksum, digest, governor, 0, nullptr, &buffer, false };
+            curl_easy_setopt(curl, CURLOPT_URL, url);
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteData);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
+            res = curl_easy_perform(curl);
+            if (context.pooled && buffer.Size() > 0) {
+                // Slab and result string both exist during the copy, so the copy is charged as well.
+                if (governor != nullptr) {
+                    governor->Charge(buffer.Size(), context.reserved);
+                    context.reserved += buffer.Size();
+                }
+                data.assign(buffer.Data(), buffer.Size());
+            }
+            if (result != nullptr) {
+                *result = res;
+            }
+            // Once returned the data belongs to the caller and is no longer in flight; the budget does not follow it.
+            if (governor != nullptr) {
+                governor->Release(context.reserved);
+            }
+        }
+        return data;
+    }
+
+    std::string PerformBufferedDownload(CURL* curl, const char* url, long bufferSize, std::chrono::microseconds& firstByte,
+                                        MemoryGovernor* governor)
+    {
+        firstByte = std::chrono::microseconds(0);
+        if (curl) {
+            curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, bufferSize);
+        }
+        std::string data = PerformDownload(curl, url, nullptr, nullptr, governor);
+        double seconds = 0;
+        if (curl && curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &seconds) == CURLE_OK) {
+            firstByte = std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
         }
-        return realsize;
+        return data;
+    }
+}
+
+FetchStatus IDownloader::DownloadDataIfModifiedSince(const std::string& url, int64_t, std::string& data,
+                                                     int64_t& lastModified) const
+{
+    std::string body = DownloadData(url);
+    if (body.empty())
+    {
+        return FetchStatus::Failed;
+    }
+    data.swap(body);
+    lastModified = 0;
+    return FetchStatus::Modified;
+}
+
+std::string IDownloader::DownloadRange(const std::string& url, uint64_t offset, uint64_t length) const
+{
+    const std::string body = DownloadData(url);
+    if (offset >= body.size())
+    {
+        return std::string();
     }
+    return body.substr(static_cast<size_t>(offset), static_cast<size_t>(std::min<uint64_t>(length, body.size() - offset)));
 }
 
+void IDownloader::DownloadChunks(const std::string& url, const ChunkSink& sink) const
+{
+    const std::string body = DownloadData(url);
+    if (!body.empty())
+    {
+        sink(body.data(), body.size());
+    }
+}
+
+Downloader::Downloader(MemoryGovernor* governor)
+    : m_governor(governor)
+{}
+
 std::string Downloader::DownloadData(const std::string& url) const
 {
-    std::stringstream ss;
-    CURL* curl;
-    CURLcode res;
+    return PerformDownload(AcquireCurl(), url.c_str(), nullptr, nullptr, m_governor);
+}
+
+// The Url overloads forward to the virtual string ones, so a subclass overriding only those still sees Url calls.
+std::string Downloader::DownloadData(const Url& url) const
+{
+    return DownloadData(url.Str());
+}
+
+std::string Downloader::DownloadData(const std::string& url, long bufferSize, std::chrono::microseconds& firstByte) const
+{
+    return PerformBufferedDownload(AcquireCurl(), url.c_str(), bufferSize, firstByte, m_governor);
+}
+
+std::string Downloader::DownloadData(const Url& url, long bufferSize, std::chrono::microseconds& firstByte) const
+{
+    return DownloadData(url.Str(), bufferSize, firstByte);
+}
+
+std::string Downloader::DownloadData(const std::string& url, uint32_t& checksum) const
+{
+    Crc32c crc;
+    std::string data = PerformDownload(AcquireCurl(), url.c_str(), &crc, nullptr, m_governor);
+    checksum = crc.Value();
+    return data;
+}
+
+std::string Downloader::DownloadData(const std::string& url, std::string& sha256) const
+{
+    Sha256 digest;
+    std::string data = PerformDownload(AcquireCurl(), url.c_str(), nullptr, &digest, m_governor);
+    sha256 = digest.HexDigest();
+    return data;
+}
+
+FetchStatus Downloader::DownloadDataIfModifiedSince(const std::string& url, int64_t since, std::string& data,
+                                                    int64_t& lastModified) const
+{
+    CURL* curl = AcquireCurl();
+    if (!curl) {
+        return FetchStatus::Failed;
+    }
+    if (since > 0) {
+        curl_easy_setopt(curl, CURLOPT_TIMECONDITION, static_cast<long>(CURL_TIMECOND_IFMODSINCE));
+        curl_easy_setopt(curl, CURLOPT_TIMEVALUE, static_cast<long>(since));
+    }
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    CURLcode res = CURLE_FAILED_INIT;
+    std::string received = PerformDownload(curl, url.c_str(), nullptr, nullptr, m_governor, &res);
+    if (res != CURLE_OK) {
+        return FetchStatus::Failed;
+    }
+    long status = 0;
+    long unmet = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(curl, CURLINFO_CONDITION_UNMET, &unmet);
+    if (status == 304 || unmet) {
+        return FetchStatus::NotModified;
+    }
+    // Non-HTTP schemes report no status at all; any other HTTP status means the body is an error page.
+    if (status != 200 && status != 0) {
+        return FetchStatus::Failed;
+    }
+    long fileTime = -1;
+    curl_easy_getinfo(curl, CURLINFO_FILETIME, &fileTime);
+    lastModified = fileTime > 0 ? fileTime : 0;
+    data = std::move(received);
+    return FetchStatus::Modified;
+}
+
+std::string Downloader::DownloadRange(const std::string& url, uint64_t offset, uint64_t length) const
+{
+    CURL* curl = AcquireCurl();
+    if (!curl || length == 0) {
+        return std::string();
+    }
+    const std::string range = std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    return PerformDownload(curl, url.c_str(), nullptr, nullptr, m_governor);
+}
 
-    curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteData);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ss);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
+void Downloader::DownloadChunks(const std::string& url, const ChunkSink& sink) const
+{
+    CURL* curl = AcquireCurl();
+    if (!curl) {
+        throw std::runtime_error("DownloadChunks: cannot create curl handle");
+    }
+    WriteContext context{ curl, nullptr, nullptr, nullptr, nullptr, 0, &sink, nullptr, false };
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteData);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
+    // An HTTP error status fails the transfer before any of the error page reaches the sink.
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    const CURLcode res = curl_easy_perform(curl);
+    if (context.error) {
+        std::rethrow_exception(context.error);
+    }
+    if (res != CURLE_OK) {
+        throw std::runtime_error("DownloadChunks: " + url + ": " + curl_easy_strerror(res));
     }
-    return ss.str();
 }
 
 TEST(Downloader, DownloadData)
 {
     Downloader downloader;
     EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt"), "FileContent");
-}
\ No newline at end of file
+}
+
+TEST(Downloader, DownloadDataFromUrl)
+{
+    Downloader downloader;
+    const Url url("http://localhost/aaa.txt");
+    EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+}
+
+namespace
+{
+    class StringOnlyDownloader : public Downloader
+    {
+    public:
+        using Downloader::DownloadData;
+        virtual std::string DownloadData(const std::string& url) const
+        {
+            return "Overridden " + url;
+        }
+        virtual std::string DownloadData(const std::string& url, long, std::chrono::microseconds& firstByte) const
+        {
+            firstByte = std::chrono::microseconds(1);
+            return "Overridden " + url;
+        }
+    };
+}
+
+TEST(Downloader, UrlOverloadsReachStringOverrides)
+{
+    StringOnlyDownloader downloader;
+    const IDownloader& base = downloader;
+    const Url url("http://localhost/aaa.txt");
+    EXPECT_EQ(downloader.DownloadData(url), "Overridden http://localhost/aaa.txt");
+    EXPECT_EQ(base.DownloadData(url), "Overridden http://localhost/aaa.txt");
+    std::chrono::microseconds firstByte(0);
+    EXPECT_EQ(downloader.DownloadData(url, 1024, firstByte), "Overridden http://localhost/aaa.txt");
+    EXPECT_EQ(firstByte.count(), 1);
+}
+
+TEST(Downloader, DownloadDataWithBufferSize)
+{
+    Downloader downloader;
+    std::chrono::microseconds firstByte(0);
+    EXPECT_EQ(downloader.DownloadData(Url("http://localhost/aaa.txt"), 256 * 1024, firstByte), "FileContent");
+    EXPECT_GT(firstByte.count(), 0);
+}
+
+TEST(Downloader, DownloadDataWithChecksum)
+{
+    Downloader downloader;
+    uint32_t checksum = 0;
+    EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt", checksum), "FileContent");
+    EXPECT_EQ(checksum, Crc32c::Compute("FileContent", 11));
+}
+
+TEST(Downloader, DownloadDataWithSha256)
+{
+    Downloader downloader;
+    std::string sha256;
+    EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt", sha256), "FileContent");
+    EXPECT_EQ(sha256, Sha256::Compute("FileContent", 11));
+}
+
+TEST(Downloader, DownloadDataIfModifiedSince)
+{
+    Downloader downloader;
+    std::string data;
+    int64_t lastModified = 0;
+    EXPECT_EQ(downloader.DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, data, lastModified), FetchStatus::Modified);
+    EXPECT_EQ(data, "FileContent");
+    EXPECT_GT(lastModified, 0);
+    data.clear();
+    EXPECT_EQ(downloader.DownloadDataIfModifiedSince("http://localhost/aaa.txt", lastModified, data, lastModified),
+              FetchStatus::NotModified);
+    EXPECT_TRUE(data.empty());
+    EXPECT_EQ(downloader.DownloadDataIfModifiedSince("http://localhost/missing.txt", 0, data, lastModified),
+              FetchStatus::Failed);
+    EXPECT_TRUE(data.empty());
+}
+
+TEST(Downloader, DownloadRange)
+{
+    Downloader downloader;
+    EXPECT_EQ(downloader.DownloadRange("http://localhost/aaa.txt", 4, 7), "Content");
+}
+
+TEST(Downloader, DownloadChunks)
+{
+    Downloader downloader;
+    std::string data;
+    downloader.DownloadChunks("http://localhost/aaa.txt", [&data](const char* chunk, size_t size) {
+        data.append(chunk, size);
+    });
+    EXPECT_EQ(data, "FileContent");
+    EXPECT_THROW(downloader.DownloadChunks("http://localhost/missing.txt", [](const char*, size_t) {}), std::runtime_error);
+    EXPECT_THROW(downloader.DownloadChunks("http://localhost/aaa.txt", [](const char*, size_t) {
+        throw std::logic_error("sink failed");
+    }), std::logic_error);
+}
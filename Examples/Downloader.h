@@ -1,15 +1,67 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <string>
 
+#include "Url.h"
+
+enum class FetchStatus
+{
+    Modified,
+    NotModified,
+    Failed
+};
+
+using ChunkSink = std::function<void(const char* data, size_t size)>;
+
 class IDownloader
 {
 public:
     virtual std::string DownloadData(const std::string& url) const = 0;
+    virtual std::string DownloadData(const Url& url) const { return DownloadData(url.Str()); }
+    // Default has no conditional requests: it always downloads, reports Modified with no Last-Modified,
+    // and treats an empty body as Failed.
+    virtual FetchStatus DownloadDataIfModifiedSince(const std::string& url, int64_t since, std::string& data,
+                                                    int64_t& lastModified) const;
+    // Default downloads the whole body and cuts the range out of it.
+    virtual std::string DownloadRange(const std::string& url, uint64_t offset, uint64_t length) const;
+    // Default downloads the whole body and hands it to `sink` in one piece; an empty body is not delivered.
+    virtual void DownloadChunks(const std::string& url, const ChunkSink& sink) const;
 };
 
+class MemoryGovernor;
+
 class Downloader : public IDownloader
 {
 public:
+    // Downloaders sharing a governor keep the data of their in-flight transfers within its budget. The charge
+    // ends when a call returns; the returned body is the caller's to account for.
+    explicit Downloader(MemoryGovernor* governor = nullptr);
+
     virtual std::string DownloadData(const std::string& url) const;
-};
+    virtual std::string DownloadData(const Url& url) const;
+    // Sets curl's receive buffer (CURLOPT_BUFFERSIZE) for this transfer and reports the time until the first
+    // byte of the response arrived, which unlike the whole transfer time does not grow with the body size.
+    virtual std::string DownloadData(const std::string& url, long bufferSize, std::chrono::microseconds& firstByte) const;
+    virtual std::string DownloadData(const Url& url, long bufferSize, std::chrono::microseconds& firstByte) const;
+    // Computes CRC-32C of the body while it is being received, so callers can verify it without a second pass.
+    // CRC-32C only detects accidental corruption.
+    virtual std::string DownloadData(const std::string& url, uint32_t& checksum) const;
+    // Same for SHA-256, given as lower-case hex; use this one to check published digests.
+    virtual std::string DownloadData(const std::string& url, std::string& sha256) const;
+    // Sends If-Modified-Since with `since` (seconds since epoch). `data` and `lastModified` (the server's
+    // Last-Modified, 0 when it sent none) are only set on Modified; transport errors and non-200 responses are Failed.
+    virtual FetchStatus DownloadDataIfModifiedSince(const std::string& url, int64_t since, std::string& data,
+                                                    int64_t& lastModified) const;
+    // Fetches `length` bytes starting at `offset` with an HTTP Range request.
+    virtual std::string DownloadRange(const std::string& url, uint64_t offset, uint64_t length) const;
+    // Hands every received chunk to `sink` from curl's write callback instead of collecting the body.
+    // The transfer does not read from the socket while `sink` is busy. A transport error or HTTP error status
+    // throws std::runtime_error, possibly after some chunks were delivered; an exception from `sink` aborts
+    // the transfer and is rethrown.
+    virtual void DownloadChunks(const std::string& url, const ChunkSink& sink) const;
 
+private:
+    MemoryGovernor* m_governor;
+};
@@ -1,12 +1,110 @@
 #include "FsWrapper.h"
 #include <fstream>
 #include <filesystem>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
+namespace
+{
+    // Random suffix so concurrent saves of the same path, from any thread or process, never share a temp file.
+    std::string TempPathFor(const std::string& filePath)
+    {
+        thread_local std::mt19937_64 random(std::random_device{}());
+        std::ostringstream path;
+        path << filePath << ".tmp" << std::hex << random();
+        return path.str();
+    }
+}
+
+bool IFsWrapper::LoadFromFile(const std::string&, std::string&) const
+{
+    return false;
+}
+
+bool IFsWrapper::Exists(const std::string& filePath) const
+{
+    std::string data;
+    return LoadFromFile(filePath, data);
+}
+
+void IFsWrapper::CopyLocalFile(const std::string& sourcePath, const std::string& filePath) const
+{
+    std::ifstream fs(sourcePath, std::ios::binary);
+    if (!fs)
+    {
+        throw std::filesystem::filesystem_error("CopyLocalFile", sourcePath,
+                                                std::make_error_code(std::errc::no_such_file_or_directory));
+    }
+    SaveToFile(std::string(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>()), filePath);
+}
+
 void FsWrapper::SaveToFile(const std::string& data, const std::string& filePath) const
 {
-    std::ofstream fs(filePath);
+    const std::string tempPath = TempPathFor(filePath);
+    std::ofstream fs(tempPath, std::ios::binary);
+    if (!fs)
+    {
+        throw std::filesystem::filesystem_error("SaveToFile", tempPath, std::make_error_code(std::errc::io_error));
+    }
     fs.write(data.data(), data.size());
+    fs.close();
+    std::error_code error;
+    if (!fs)
+    {
+        std::filesystem::remove(tempPath, error);
+        throw std::filesystem::filesystem_error("SaveToFile", tempPath, std::make_error_code(std::errc::io_error));
+    }
+    std::filesystem::rename(tempPath, filePath, error);
+    if (error)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(tempPath, ignored);
+        throw std::filesystem::filesystem_error("SaveToFile", tempPath, filePath, error);
+    }
+}
+
+bool FsWrapper::LoadFromFile(const std::string& filePath, std::string& data) const
+{
+    std::ifstream fs(filePath, std::ios::binary);
+    if (!fs)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool FsWrapper::LoadRange(const std::string& filePath, uint64_t offset, uint64_t length, std::string& data) const
+{
+    // The size is checked first so a bogus length read from some header fails without allocating it.
+    std::ifstream fs(filePath, std::ios::binary | std::ios::ate);
+    const std::streamoff size = fs ? static_cast<std::streamoff>(fs.tellg()) : -1;
+    if (size < 0 || offset > static_cast<uint64_t>(size) || length > static_cast<uint64_t>(size) - offset
+        || !fs.seekg(static_cast<std::streamoff>(offset)))
+    {
+        return false;
+    }
+    std::string range(static_cast<size_t>(length), '\0');
+    if (!fs.read(&range[0], static_cast<std::streamsize>(range.size())))
+    {
+        return false;
+    }
+    data.swap(range);
+    return true;
+}
+
+bool FsWrapper::Exists(const std::string& filePath) const
+{
+    std::error_code error;
+    return std::filesystem::is_regular_file(filePath, error);
+}
+
+void FsWrapper::CopyLocalFile(const std::string& sourcePath, const std::string& filePath) const
+{
+    std::filesystem::copy_file(sourcePath, filePath, std::filesystem::copy_options::overwrite_existing);
 }
 
 
@@ -20,4 +118,96 @@ TEST(FsWrapper, SaveToFile)
     std::ifstream file(fileName);
     std::string str((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     EXPECT_EQ(str, "FileContent");
-}
\ No newline at end of file
+}
+
+TEST(FsWrapper, LoadFromFile)
+{
+    std::string fileName = "C:\\ddd.txt";
+    FsWrapper fs;
+    std::string data;
+    EXPECT_FALSE(fs.LoadFromFile(fileName, data));
+    fs.SaveToFile("FileContent", fileName);
+    ASSERT_TRUE(fs.LoadFromFile(fileName, data));
+    EXPECT_EQ(data, "FileContent");
+    std::filesystem::remove(fileName);
+}
+
+TEST(FsWrapper, LoadRange)
+{
+    std::string fileName = "C:\\hhh.txt";
+    FsWrapper fs;
+    std::string data;
+    EXPECT_FALSE(fs.LoadRange(fileName, 0, 1, data));
+    fs.SaveToFile("FileContent", fileName);
+    ASSERT_TRUE(fs.LoadRange(fileName, 4, 7, data));
+    EXPECT_EQ(data, "Content");
+    EXPECT_FALSE(fs.LoadRange(fileName, 4, 8, data));
+    EXPECT_EQ(data, "Content");
+    std::filesystem::remove(fileName);
+}
+
+TEST(FsWrapper, Exists)
+{
+    std::string fileName = "C:\\eee.txt";
+    FsWrapper fs;
+    EXPECT_FALSE(fs.Exists(fileName));
+    fs.SaveToFile("FileContent", fileName);
+    EXPECT_TRUE(fs.Exists(fileName));
+    std::filesystem::remove(fileName);
+}
+
+TEST(FsWrapper, CopyLocalFile)
+{
+    std::string sourceName = "C:\\aaa.txt";
+    std::string fileName = "C:\\ccc.txt";
+    EXPECT_FALSE(std::filesystem::exists(fileName));
+    FsWrapper fs;
+    fs.SaveToFile("FileContent", sourceName);
+    fs.CopyLocalFile(sourceName, fileName);
+    ASSERT_TRUE(std::filesystem::exists(fileName));
+    std::ifstream file(fileName);
+    std::string str((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(str, "FileContent");
+    file.close();
+    std::filesystem::remove(sourceName);
+    std::filesystem::remove(fileName);
+}
+
+TEST(FsWrapper, SaveToFileFailureKeepsTargetAndRemovesTemp)
+{
+    const std::string fileName = "C:\\fff_dir";
+    std::filesystem::create_directory(fileName);
+    FsWrapper fs;
+    EXPECT_THROW(fs.SaveToFile("FileContent", fileName), std::filesystem::filesystem_error);
+    EXPECT_TRUE(std::filesystem::is_directory(fileName));
+    const std::filesystem::path target = std::filesystem::absolute(fileName);
+    for (const auto& entry : std::filesystem::directory_iterator(target.parent_path()))
+    {
+        EXPECT_NE(entry.path().filename().string().find(target.filename().string() + ".tmp"), 0u);
+    }
+    std::filesystem::remove(fileName);
+}
+
+TEST(FsWrapper, SaveToFileFromManyThreads)
+{
+    const std::string fileName = "C:\\ggg.txt";
+    FsWrapper fs;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&fs, &fileName, t]() {
+            for (int i = 0; i < 50; ++i)
+            {
+                fs.SaveToFile(std::string(1000, static_cast<char>('a' + t)), fileName);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile(fileName, data));
+    EXPECT_EQ(data, std::string(1000, data[0]));
+    std::filesystem::remove(fileName);
+}
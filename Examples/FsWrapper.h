@@ -1,15 +1,30 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
 class IFsWrapper
 {
 public:
     virtual void SaveToFile(const std::string& data, const std::string& filePath) const = 0;
+    // Defaults are for write-only wrappers: nothing can be read back, so every file counts as missing.
+    virtual bool LoadFromFile(const std::string& filePath, std::string& data) const;
+    virtual bool Exists(const std::string& filePath) const;
+    // Default reads the source into memory and saves it; wrappers backed by a real file system copy directly.
+    virtual void CopyLocalFile(const std::string& sourcePath, const std::string& filePath) const;
 };
 
-class FsWrapper
+class FsWrapper : public IFsWrapper
 {
 public:
+    // Writes to a uniquely named temporary file next to `filePath` and renames it over, so readers never see a
+    // partial file. On failure the temporary file is removed, the target is left as it was, and
+    // std::filesystem::filesystem_error is thrown.
     virtual void SaveToFile(const std::string& data, const std::string& filePath) const;
+    virtual bool LoadFromFile(const std::string& filePath, std::string& data) const;
+    // Reads exactly `length` bytes starting at `offset`; false if the file is missing or too short.
+    virtual bool LoadRange(const std::string& filePath, uint64_t offset, uint64_t length, std::string& data) const;
+    virtual bool Exists(const std::string& filePath) const;
+    // Copies inside the kernel (copy_file_range/sendfile, CopyFile on Windows) without reading data into memory.
+    virtual void CopyLocalFile(const std::string& sourcePath, const std::string& filePath) const;
 };
 
@@ -0,0 +1,254 @@
+#include "HedgingDownloader.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <set>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "LoopbackDownloader.h"
+
+namespace
+{
+    const size_t MinSamples = 20;
+    // Step of the quantile estimate; larger adapts faster but jitters more.
+    const double EstimateStep = 0.05;
+
+    struct Race
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        int attempts = 0;
+        int failed = 0;
+        int winner = -1;
+        std::string data;
+        std::exception_ptr error;
+    };
+}
+
+HedgingDownloader::HedgingDownloader(const IDownloader& downloader, double hedgeQuantile, double hedgeBudget,
+                                     std::chrono::microseconds initialDelay)
+    : m_downloader(downloader)
+    , m_hedgeQuantile(hedgeQuantile)
+    , m_hedgeBudget(hedgeBudget)
+    , m_initialDelay(initialDelay)
+    , m_delayEstimate(static_cast<double>(std::max<int64_t>(initialDelay.count(), 1)))
+{}
+
+HedgingDownloader::~HedgingDownloader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void HedgingDownloader::Submit(std::function<void()> task) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(task));
+    if (++m_pendingAttempts > m_workers.size())
+    {
+        m_workers.emplace_back(&HedgingDownloader::WorkerLoop, this);
+    }
+    else
+    {
+        m_work.notify_one();
+    }
+}
+
+// Workers drain the queue before exiting, so the destructor also waits for abandoned attempts.
+void HedgingDownloader::WorkerLoop() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_work.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            return;
+        }
+        std::function<void()> task = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+std::string HedgingDownloader::DownloadData(const std::string& url) const
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto race = std::make_shared<Race>();
+    auto launch = [this, race, url](int attempt) {
+        ++race->attempts;
+        Submit([this, race, url, attempt]() {
+            std::string data;
+            std::exception_ptr error;
+            try
+            {
+                data = m_downloader.DownloadData(url);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_pendingAttempts;
+            }
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                if (error)
+                {
+                    ++race->failed;
+                    if (!race->error)
+                    {
+                        race->error = error;
+                    }
+                }
+                else if (race->winner < 0)
+                {
+                    race->winner = attempt;
+                    race->data = std::move(data);
+                }
+            }
+            race->finished.notify_all();
+        });
+    };
+
+    std::unique_lock<std::mutex> raceLock(race->mutex);
+    launch(0);
+    const auto done = [&race]() { return race->winner >= 0 || race->failed == race->attempts; };
+    if (!race->finished.wait_for(raceLock, HedgeDelay(), done))
+    {
+        bool hedge = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            hedge = m_stats.hedges < m_hedgeBudget * (m_stats.requests + 1);
+            if (hedge)
+            {
+                ++m_stats.hedges;
+            }
+        }
+        if (hedge)
+        {
+            launch(1);
+        }
+        race->finished.wait(raceLock, done);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.requests;
+    if (race->winner < 0)
+    {
+        std::rethrow_exception(race->error);
+    }
+    if (race->winner > 0)
+    {
+        ++m_stats.hedgeWins;
+    }
+    RecordLatency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+    return std::move(race->data);
+}
+
+HedgingStats HedgingDownloader::Stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::chrono::microseconds HedgingDownloader::HedgeDelay() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_samples < MinSamples)
+    {
+        return m_initialDelay;
+    }
+    return std::chrono::microseconds(static_cast<int64_t>(m_delayEstimate));
+}
+
+// Multiplicative stochastic approximation: the estimate settles where a fraction (1 - quantile) of
+// samples lies above it. Old samples fade out on their own, so the delay follows shifts in latency.
+void HedgingDownloader::RecordLatency(std::chrono::microseconds latency) const
+{
+    ++m_samples;
+    if (static_cast<double>(latency.count()) > m_delayEstimate)
+    {
+        m_delayEstimate *= 1 + EstimateStep * m_hedgeQuantile;
+    }
+    else
+    {
+        m_delayEstimate = std::max(1.0, m_delayEstimate * (1 - EstimateStep * (1 - m_hedgeQuantile)));
+    }
+}
+
+TEST(HedgingDownloader, DownloadDataHedgesStalledRequest)
+{
+    std::atomic<int> calls{ 0 };
+    LoopbackDownloader loopback([]() { return size_t(16); }, [&calls]() {
+        return calls++ == 0 ? std::chrono::microseconds(std::chrono::milliseconds(300)) : std::chrono::microseconds(0);
+    });
+    const auto start = std::chrono::steady_clock::now();
+    {
+        HedgingDownloader downloader(loopback, 0.95, 0.05, std::chrono::milliseconds(10));
+        const std::string data = downloader.DownloadData("http://localhost/aaa.txt");
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+        EXPECT_EQ(data, loopback.DownloadData("http://localhost/aaa.txt"));
+        EXPECT_EQ(downloader.Stats().hedges, 1u);
+        EXPECT_EQ(downloader.Stats().hedgeWins, 1u);
+    }
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+}
+
+TEST(HedgingDownloader, DownloadDataRespectsHedgeBudget)
+{
+    LoopbackDownloader loopback([]() { return size_t(16); }, []() { return std::chrono::milliseconds(5); });
+    HedgingDownloader downloader(loopback, 0.95, 0.0, std::chrono::milliseconds(1));
+    for (int i = 0; i < 10; ++i)
+    {
+        downloader.DownloadData("http://localhost/aaa.txt");
+    }
+    EXPECT_EQ(downloader.Stats().requests, 10u);
+    EXPECT_EQ(downloader.Stats().hedges, 0u);
+    EXPECT_EQ(loopback.RequestCount(), 10u);
+}
+
+TEST(HedgingDownloader, DownloadDataAdaptsDelayToObservedLatency)
+{
+    LoopbackDownloader loopback([]() { return size_t(16); }, []() { return std::chrono::milliseconds(2); });
+    HedgingDownloader downloader(loopback, 0.95, 1.0, std::chrono::milliseconds(1));
+    for (int i = 0; i < 50; ++i)
+    {
+        downloader.DownloadData("http://localhost/aaa.txt");
+    }
+    const size_t warmupHedges = downloader.Stats().hedges;
+    for (int i = 0; i < 50; ++i)
+    {
+        downloader.DownloadData("http://localhost/aaa.txt");
+    }
+    EXPECT_LT(downloader.Stats().hedges - warmupHedges, 25u);
+}
+
+TEST(HedgingDownloader, DownloadDataReusesWorkerThreads)
+{
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    LoopbackDownloader loopback([]() { return size_t(16); }, [&mutex, &threads]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+        return std::chrono::microseconds(0);
+    });
+    HedgingDownloader downloader(loopback, 0.95, 0.0, std::chrono::seconds(1));
+    for (int i = 0; i < 20; ++i)
+    {
+        downloader.DownloadData("http://localhost/aaa.txt");
+    }
+    EXPECT_EQ(threads.size(), 1u);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Downloader.h"
+
+struct HedgingStats
+{
+    size_t requests = 0;
+    size_t hedges = 0;
+    size_t hedgeWins = 0;
+};
+
+// Decorator that sends a second request when the first one is slower than the recent latency
+// percentile and returns whichever finishes first. At most `hedgeBudget` of all requests are hedged.
+// The losing request cannot be interrupted through IDownloader, so its result is dropped when it
+// finishes; the destructor waits for such requests, so the wrapped downloader must outlive this object.
+// Attempts run on persistent workers, so per-thread state of the wrapped downloader (Downloader keeps
+// its curl handle and connections per thread) is reused across requests. A worker is added only when
+// there are more unfinished attempts than workers, so the pool grows to the peak number of concurrent attempts.
+class HedgingDownloader : public IDownloader
+{
+public:
+    HedgingDownloader(const IDownloader& downloader, double hedgeQuantile = 0.95, double hedgeBudget = 0.05,
+                      std::chrono::microseconds initialDelay = std::chrono::milliseconds(100));
+    ~HedgingDownloader();
+
+    using IDownloader::DownloadData;
+    virtual std::string DownloadData(const std::string& url) const;
+    HedgingStats Stats() const;
+
+private:
+    std::chrono::microseconds HedgeDelay() const;
+    void RecordLatency(std::chrono::microseconds latency) const;
+    void Submit(std::function<void()> task) const;
+    void WorkerLoop() const;
+
+    const IDownloader& m_downloader;
+    const double m_hedgeQuantile;
+    const double m_hedgeBudget;
+    const std::chrono::microseconds m_initialDelay;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_work;
+    mutable std::deque<std::function<void()>> m_queue;
+    mutable std::vector<std::thread> m_workers;
+    // Queued plus running attempts; an attempt counts as finished before its caller is woken.
+    mutable size_t m_pendingAttempts = 0;
+    mutable bool m_stopping = false;
+    // Running estimate of the hedge quantile, updated in O(1) per sample.
+    mutable double m_delayEstimate;
+    mutable size_t m_samples = 0;
+    mutable HedgingStats m_stats;
+};
@@ -0,0 +1,144 @@
+#include "InMemoryFsWrapper.h"
+#include "LoopbackDownloader.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+InMemoryFsWrapper::InMemoryFsWrapper(size_t shardCount)
+    : m_shardCount(shardCount > 0 ? shardCount : 1)
+    , m_shards(std::make_unique<Shard[]>(m_shardCount))
+{}
+
+void InMemoryFsWrapper::SaveToFile(const std::string& data, const std::string& filePath) const
+{
+    Shard& shard = ShardFor(filePath);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.files[filePath] = data;
+}
+
+bool InMemoryFsWrapper::LoadFromFile(const std::string& filePath, std::string& data) const
+{
+    Shard& shard = ShardFor(filePath);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.files.find(filePath);
+    if (it == shard.files.end())
+    {
+        return false;
+    }
+    data = it->second;
+    return true;
+}
+
+size_t InMemoryFsWrapper::FileCount() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < m_shardCount; ++i)
+    {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        count += m_shards[i].files.size();
+    }
+    return count;
+}
+
+InMemoryFsWrapper::Shard& InMemoryFsWrapper::ShardFor(const std::string& filePath) const
+{
+    return m_shards[std::hash<std::string>()(filePath) % m_shardCount];
+}
+
+TEST(InMemoryFsWrapper, SaveToFile)
+{
+    InMemoryFsWrapper fs;
+    std::string data;
+    EXPECT_FALSE(fs.LoadFromFile("C:\\bbb.txt", data));
+    fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+    fs.SaveToFile("NewContent", "C:\\bbb.txt");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "NewContent");
+    EXPECT_EQ(fs.FileCount(), 1u);
+}
+
+TEST(InMemoryFsWrapper, CopyLocalFile)
+{
+    const std::string sourceName = "C:\\aaa_local.txt";
+    {
+        std::ofstream source(sourceName, std::ios::binary);
+        source << "FileContent";
+    }
+    InMemoryFsWrapper fs;
+    fs.CopyLocalFile(sourceName, "C:\\bbb.txt");
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+    std::filesystem::remove(sourceName);
+    EXPECT_THROW(fs.CopyLocalFile(sourceName, "C:\\ccc.txt"), std::filesystem::filesystem_error);
+}
+
+TEST(InMemoryFsWrapper, SaveToFileFromManyThreads)
+{
+    InMemoryFsWrapper fs;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&fs, t]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                fs.SaveToFile("FileContent", "C:\\" + std::to_string(t) + "_" + std::to_string(i) + ".txt");
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(fs.FileCount(), 8000u);
+}
+
+namespace
+{
+    // Runs `threads` x `perThread` download-and-save round trips, each to its own path, and returns files per second.
+    double MeasureThroughput(const IDownloader& downloader, const IFsWrapper& fs, int threads, int perThread)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&downloader, &fs, t, perThread]() {
+                for (int i = 0; i < perThread; ++i)
+                {
+                    const std::string name = std::to_string(t) + "_" + std::to_string(i);
+                    fs.SaveToFile(downloader.DownloadData("http://localhost/" + name), "C:\\" + name + ".txt");
+                }
+            });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return threads * perThread / elapsed.count();
+    }
+}
+
+TEST(InMemoryFsWrapper, ShardingDoesNotHalveThroughput)
+{
+    LoopbackDownloader downloader([]() { return size_t(1024); });
+    InMemoryFsWrapper singleShard(1);
+    InMemoryFsWrapper sharded;
+    const double singleShardRate = MeasureThroughput(downloader, singleShard, 8, 2000);
+    const double shardedRate = MeasureThroughput(downloader, sharded, 8, 2000);
+    RecordProperty("singleShardFilesPerSecond", std::to_string(static_cast<int64_t>(singleShardRate)));
+    RecordProperty("shardedFilesPerSecond", std::to_string(static_cast<int64_t>(shardedRate)));
+
+    EXPECT_EQ(sharded.FileCount(), 16000u);
+    std::string data;
+    ASSERT_TRUE(sharded.LoadFromFile("C:\\7_1999.txt", data));
+    EXPECT_EQ(data, downloader.DownloadData("http://localhost/7_1999"));
+    // Speedup depends on the core count, so the rates are only recorded; the check only catches a large regression.
+    EXPECT_GT(shardedRate, singleShardRate / 2);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "FsWrapper.h"
+
+// RAM-backed IFsWrapper for stress tests. Paths are spread over independently locked shards
+// so concurrent writers rarely contend.
+class InMemoryFsWrapper : public IFsWrapper
+{
+public:
+    explicit InMemoryFsWrapper(size_t shardCount = 64);
+
+    virtual void SaveToFile(const std::string& data, const std::string& filePath) const;
+    bool LoadFromFile(const std::string& filePath, std::string& data) const;
+    size_t FileCount() const;
+
+private:
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::string> files;
+    };
+
+    Shard& ShardFor(const std::string& filePath) const;
+
+    size_t m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+};
@@ -16,6 +16,7 @@ namespace
     class MockDownloader : public IDownloader
     {
     public:
+        using IDownloader::DownloadData;
         MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
     };
 
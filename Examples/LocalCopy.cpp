@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cctype>
+#include <gmock/gmock.h>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+
+using namespace testing;
+
+namespace
+{
+    const std::string FileScheme = "file://";
+
+    bool PercentDecode(const std::string& encoded, std::string& decoded)
+    {
+        decoded.clear();
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            if (encoded[i] != '%')
+            {
+                decoded.push_back(encoded[i]);
+                continue;
+            }
+            if (i + 2 >= encoded.size() || !std::isxdigit(static_cast<unsigned char>(encoded[i + 1]))
+                || !std::isxdigit(static_cast<unsigned char>(encoded[i + 2])))
+            {
+                return false;
+            }
+            const char value = static_cast<char>(std::stoi(encoded.substr(i + 1, 2), nullptr, 16));
+            if (value == '\0')
+            {
+                return false;
+            }
+            decoded.push_back(value);
+            i += 2;
+        }
+        return true;
+    }
+
+    // "file:///C:/dir/a%20b.txt" -> "C:/dir/a b.txt", "file://localhost/mnt/aaa.txt" -> "/mnt/aaa.txt".
+    // Any other host is a network share: "file://server/share/aaa.txt" -> "//server/share/aaa.txt" on Windows,
+    // rejected elsewhere since there is no portable way to reach it.
+    bool LocalPathFromUrl(const std::string& url, std::string& path)
+    {
+        const size_t slash = url.find('/', FileScheme.size());
+        if (slash == std::string::npos || !PercentDecode(url.substr(slash), path))
+        {
+            return false;
+        }
+        std::string host = url.substr(FileScheme.size(), slash - FileScheme.size());
+        std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (!host.empty() && host != "localhost")
+        {
+#ifdef _WIN32
+            path = "//" + host + path;
+            return true;
+#else
+            return false;
+#endif
+        }
+        if (path.size() > 2 && path[0] == '/' && path[2] == ':')
+        {
+            path.erase(0, 1);
+        }
+        return true;
+    }
+
+    // Local and mounted sources are copied by the file system directly instead of being read through curl into memory.
+    int DownloadFile(const IDownloader& downloader, const IFsWrapper& fs, const std::string& url) {
+        if (url.compare(0, FileScheme.size(), FileScheme) == 0)
+        {
+            std::string path;
+            if (!LocalPathFromUrl(url, path))
+            {
+                return 1;
+            }
+            fs.CopyLocalFile(path, "C:\\bbb.txt");
+            return 0;
+        }
+        const auto& downloadedData = downloader.DownloadData(url);
+        fs.SaveToFile(downloadedData, "C:\\bbb.txt");
+        return 0;
+    }
+
+    class MockDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
+    };
+
+    class MockFsWrapper : public IFsWrapper
+    {
+    public:
+        MOCK_CONST_METHOD2(SaveToFile, void(const std::string&, const std::string&));
+        MOCK_CONST_METHOD2(CopyLocalFile, void(const std::string&, const std::string&));
+    };
+}
+
+TEST(LocalCopy, DownloadFileCopiesLocalSource)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData(_)).Times(0);
+    EXPECT_CALL(fs, SaveToFile(_, _)).Times(0);
+    EXPECT_CALL(fs, CopyLocalFile("C:/share/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_CALL(fs, CopyLocalFile("/mnt/share/a b.txt", "C:\\bbb.txt"));
+    EXPECT_CALL(fs, CopyLocalFile("/mnt/share/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(DownloadFile(downloader, fs, "file:///C:/share/aaa.txt"), 0);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file:///mnt/share/a%20b.txt"), 0);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file://LocalHost/mnt/share/aaa.txt"), 0);
+}
+
+TEST(LocalCopy, DownloadFileHandlesNetworkShares)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData(_)).Times(0);
+#ifdef _WIN32
+    EXPECT_CALL(fs, CopyLocalFile("//server/share/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(DownloadFile(downloader, fs, "file://server/share/aaa.txt"), 0);
+#else
+    EXPECT_CALL(fs, CopyLocalFile(_, _)).Times(0);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file://server/share/aaa.txt"), 1);
+#endif
+}
+
+TEST(LocalCopy, DownloadFileRejectsMalformedUrl)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(fs, CopyLocalFile(_, _)).Times(0);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file:///mnt/a%2"), 1);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file:///mnt/a%00b"), 1);
+    EXPECT_EQ(DownloadFile(downloader, fs, "file://"), 1);
+}
+
+TEST(LocalCopy, DownloadFileDownloadsRemoteSource)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt")).WillOnce(Return("FileContent"));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt"));
+    EXPECT_CALL(fs, CopyLocalFile(_, _)).Times(0);
+    DownloadFile(downloader, fs, "http://localhost/aaa.txt");
+}
@@ -0,0 +1,47 @@
+#include "LoopbackDownloader.h"
+#include <thread>
+#include <gtest/gtest.h>
+
+LoopbackDownloader::LoopbackDownloader(SizeSampler size, LatencySampler latency)
+    : m_size(std::move(size))
+    , m_latency(std::move(latency))
+{}
+
+std::string LoopbackDownloader::DownloadData(const std::string& url) const
+{
+    ++m_requests;
+    if (m_latency)
+    {
+        std::this_thread::sleep_for(m_latency());
+    }
+    // Content depends only on url and size, so tests can check what was saved.
+    std::string data(m_size(), '\0');
+    const size_t seed = std::hash<std::string>()(url);
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>('a' + (seed + i) % 26);
+    }
+    return data;
+}
+
+size_t LoopbackDownloader::RequestCount() const
+{
+    return m_requests;
+}
+
+TEST(LoopbackDownloader, DownloadData)
+{
+    LoopbackDownloader downloader([]() { return size_t(1024); });
+    const std::string data = downloader.DownloadData("http://localhost/aaa.txt");
+    EXPECT_EQ(data.size(), 1024u);
+    EXPECT_EQ(data, downloader.DownloadData("http://localhost/aaa.txt"));
+    EXPECT_EQ(downloader.RequestCount(), 2u);
+}
+
+TEST(LoopbackDownloader, DownloadDataWaitsForLatency)
+{
+    LoopbackDownloader downloader([]() { return size_t(0); }, []() { return std::chrono::milliseconds(20); });
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(downloader.DownloadData("http://localhost/aaa.txt").empty());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include "Downloader.h"
+
+// IDownloader that synthesizes payloads instead of going to the network, for throughput tests.
+// Samplers are called concurrently, so they must be thread-safe.
+class LoopbackDownloader : public IDownloader
+{
+public:
+    using SizeSampler = std::function<size_t()>;
+    using LatencySampler = std::function<std::chrono::microseconds()>;
+
+    explicit LoopbackDownloader(SizeSampler size, LatencySampler latency = nullptr);
+
+    using IDownloader::DownloadData;
+    virtual std::string DownloadData(const std::string& url) const;
+    size_t RequestCount() const;
+
+private:
+    SizeSampler m_size;
+    LatencySampler m_latency;
+    mutable std::atomic<size_t> m_requests{ 0 };
+};
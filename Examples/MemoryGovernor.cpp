@@ -0,0 +1,202 @@
+#include "MemoryGovernor.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+MemoryGovernor::MemoryGovernor(uint64_t budget)
+    : m_budget(budget)
+{}
+
+void MemoryGovernor::Reserve(uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint64_t ticket = m_nextReservation++;
+    m_released.wait(lock, [this, ticket, bytes]() {
+        return ticket == m_servingReservation && m_servingCharge == m_nextCharge
+            && (m_used == 0 || m_used + bytes <= m_budget);
+    });
+    ++m_servingReservation;
+    m_used += bytes;
+    m_peak = std::max(m_peak, m_used);
+    if (bytes > 0)
+    {
+        ++m_holders;
+    }
+    lock.unlock();
+    m_released.notify_all();
+}
+
+void MemoryGovernor::Charge(uint64_t bytes, uint64_t held)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint64_t ticket = m_nextCharge++;
+    if (held > 0)
+    {
+        ++m_waitingHolders;
+        // This may be the last holder to start waiting, which lets the oldest charge through.
+        m_released.notify_all();
+    }
+    m_released.wait(lock, [this, ticket, bytes]() {
+        return ticket == m_servingCharge
+            && (m_used == 0 || m_used + bytes <= m_budget || m_waitingHolders >= m_holders);
+    });
+    ++m_servingCharge;
+    if (held > 0)
+    {
+        --m_waitingHolders;
+    }
+    else if (bytes > 0)
+    {
+        ++m_holders;
+    }
+    m_used += bytes;
+    m_peak = std::max(m_peak, m_used);
+    lock.unlock();
+    m_released.notify_all();
+}
+
+void MemoryGovernor::Release(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= std::min(bytes, m_used);
+        if (bytes > 0 && m_holders > 0)
+        {
+            --m_holders;
+        }
+    }
+    m_released.notify_all();
+}
+
+uint64_t MemoryGovernor::Used() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+uint64_t MemoryGovernor::Peak() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peak;
+}
+
+TEST(MemoryGovernor, ReserveWaitsForRelease)
+{
+    MemoryGovernor governor(100);
+    governor.Reserve(60);
+    std::atomic<bool> reserved{ false };
+    std::thread waiter([&]() {
+        governor.Reserve(50);
+        reserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(reserved);
+    governor.Release(60);
+    waiter.join();
+    EXPECT_TRUE(reserved);
+    EXPECT_EQ(governor.Used(), 50u);
+    EXPECT_EQ(governor.Peak(), 60u);
+}
+
+TEST(MemoryGovernor, ReserveAdmitsOversizedRequestWhenIdle)
+{
+    MemoryGovernor governor(100);
+    governor.Reserve(500);
+    EXPECT_EQ(governor.Used(), 500u);
+    governor.Release(500);
+    governor.Charge(30, 0);
+    EXPECT_EQ(governor.Used(), 30u);
+    EXPECT_EQ(governor.Peak(), 500u);
+}
+
+TEST(MemoryGovernor, ConcurrentReservationsStayWithinBudget)
+{
+    MemoryGovernor governor(1000);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&governor]() {
+            for (int i = 0; i < 200; ++i)
+            {
+                governor.Reserve(300);
+                governor.Release(300);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(governor.Used(), 0u);
+    EXPECT_LE(governor.Peak(), 1000u);
+}
+
+TEST(MemoryGovernor, ReserveAdmitsInArrivalOrder)
+{
+    MemoryGovernor governor(100);
+    governor.Reserve(60);
+    std::atomic<bool> largeReserved{ false };
+    std::atomic<bool> smallReserved{ false };
+    std::thread large([&]() {
+        governor.Reserve(100);
+        largeReserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread small([&]() {
+        governor.Reserve(30);
+        smallReserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // The small request would fit, but it arrived after the large one.
+    EXPECT_FALSE(largeReserved);
+    EXPECT_FALSE(smallReserved);
+    governor.Release(60);
+    large.join();
+    EXPECT_TRUE(largeReserved);
+    EXPECT_FALSE(smallReserved);
+    governor.Release(100);
+    small.join();
+    EXPECT_EQ(governor.Used(), 30u);
+}
+
+TEST(MemoryGovernor, ChargeWaitsWhenOverBudget)
+{
+    MemoryGovernor governor(100);
+    governor.Reserve(60);
+    governor.Reserve(20);
+    std::atomic<bool> charged{ false };
+    std::thread grower([&]() {
+        governor.Charge(50, 20);
+        charged = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(charged);
+    governor.Release(60);
+    grower.join();
+    EXPECT_TRUE(charged);
+    EXPECT_EQ(governor.Used(), 70u);
+    EXPECT_EQ(governor.Peak(), 80u);
+}
+
+TEST(MemoryGovernor, ChargeLetsOldestThroughWhenAllHoldersWait)
+{
+    MemoryGovernor governor(100);
+    governor.Reserve(50);
+    governor.Reserve(50);
+    std::vector<std::thread> growers;
+    for (int i = 0; i < 2; ++i)
+    {
+        growers.emplace_back([&governor]() {
+            governor.Charge(50, 50);
+            governor.Release(100);
+        });
+    }
+    for (auto& grower : growers)
+    {
+        grower.join();
+    }
+    EXPECT_EQ(governor.Used(), 0u);
+    EXPECT_EQ(governor.Peak(), 150u);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Budget for transfer data held in memory, shared by all downloaders that are given the same instance.
+// It covers bytes in transit only: a transfer's charge is released when DownloadData returns, so bodies the
+// caller keeps afterwards (e.g. until SaveToFile) are not counted. Peak RSS is bounded by the budget plus
+// whatever the callers hold, so limit the number of returned bodies alive at once separately.
+class MemoryGovernor
+{
+public:
+    explicit MemoryGovernor(uint64_t budget);
+
+    // Blocks until `bytes` fit into the budget. Reservations are admitted in arrival order, so a large one
+    // is not starved by a stream of small ones; one bigger than the whole budget is let through once
+    // nothing else is in use.
+    void Reserve(uint64_t bytes);
+    // Accounts `bytes` more for a transfer already holding `held`, for data whose size was not known up
+    // front. Blocks like Reserve while over budget, ahead of waiting reservations since finishing running
+    // transfers is what frees memory. When every transfer holding memory is waiting here, the oldest is
+    // let through so they cannot deadlock.
+    void Charge(uint64_t bytes, uint64_t held);
+    // Returns everything one transfer holds.
+    void Release(uint64_t bytes);
+
+    uint64_t Used() const;
+    uint64_t Peak() const;
+
+private:
+    const uint64_t m_budget;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    uint64_t m_used = 0;
+    uint64_t m_peak = 0;
+    // Tickets: waiters are admitted when the serving number reaches theirs.
+    uint64_t m_nextReservation = 0;
+    uint64_t m_servingReservation = 0;
+    uint64_t m_nextCharge = 0;
+    uint64_t m_servingCharge = 0;
+    size_t m_holders = 0;
+    size_t m_waitingHolders = 0;
+};
@@ -0,0 +1,203 @@
+#include "MirrorSync.h"
+#include "Crc32c.h"
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <gmock/gmock.h>
+
+using namespace testing;
+
+MirrorSync::MirrorSync(const IDownloader& downloader, const IFsWrapper& fs)
+    : m_downloader(downloader)
+    , m_fs(fs)
+{}
+
+bool MirrorSync::Sync(const std::string& url, const std::string& filePath)
+{
+    const auto it = m_index.find(url);
+    const bool present = it != m_index.end() && it->second.filePath == filePath && m_fs.Exists(filePath);
+
+    std::string data;
+    int64_t lastModified = 0;
+    switch (m_downloader.DownloadDataIfModifiedSince(url, present ? it->second.lastModified : 0, data, lastModified))
+    {
+    case FetchStatus::Failed:
+        ++m_report.failed;
+        return false;
+    case FetchStatus::NotModified:
+        if (present)
+        {
+            ++m_report.unchanged;
+            m_report.bytesSaved += it->second.size;
+            return false;
+        }
+        // Only reachable if the server ignores a zero If-Modified-Since; there is nothing to write.
+        ++m_report.failed;
+        return false;
+    case FetchStatus::Modified:
+        break;
+    }
+
+    m_report.bytesDownloaded += data.size();
+    MirrorEntry entry{ lastModified, data.size(), Crc32c::Compute(data.data(), data.size()), filePath };
+    if (present && it->second.size == entry.size && it->second.checksum == entry.checksum)
+    {
+        // Server reported a change but content is the same, so the local file is still valid.
+        it->second.lastModified = lastModified;
+        ++m_report.unchanged;
+        return false;
+    }
+
+    m_fs.SaveToFile(data, filePath);
+    m_index[url] = entry;
+    ++m_report.downloaded;
+    return true;
+}
+
+void MirrorSync::LoadIndex(std::istream& in)
+{
+    MirrorEntry entry;
+    std::string url;
+    while (in >> entry.lastModified >> entry.size >> entry.checksum >> url)
+    {
+        in.ignore(1);
+        std::getline(in, entry.filePath);
+        m_index[url] = entry;
+    }
+}
+
+void MirrorSync::SaveIndex(std::ostream& out) const
+{
+    for (const auto& item : m_index)
+    {
+        out << item.second.lastModified << ' ' << item.second.size << ' ' << item.second.checksum << ' ' << item.first
+            << ' ' << item.second.filePath << '\n';
+    }
+}
+
+const MirrorReport& MirrorSync::Report() const
+{
+    return m_report;
+}
+
+namespace
+{
+    class MockDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
+        MOCK_CONST_METHOD4(DownloadDataIfModifiedSince, FetchStatus(const std::string&, int64_t, std::string&, int64_t&));
+    };
+
+    class MockFsWrapper : public IFsWrapper
+    {
+    public:
+        MOCK_CONST_METHOD2(SaveToFile, void(const std::string&, const std::string&));
+        MOCK_CONST_METHOD1(Exists, bool(const std::string&));
+    };
+
+    const int64_t LastModified = 1500000000;
+}
+
+TEST(MirrorSync, SyncDownloadsUnknownFile)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    MirrorSync sync(downloader, fs);
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, _, _))
+        .WillOnce(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt"));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(sync.Report().downloaded, 1u);
+    EXPECT_EQ(sync.Report().bytesDownloaded, 11u);
+}
+
+TEST(MirrorSync, SyncSkipsNotModifiedFile)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    MirrorSync sync(downloader, fs);
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, _, _))
+        .WillOnce(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", LastModified, _, _))
+        .WillOnce(Return(FetchStatus::NotModified));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt")).Times(1);
+    EXPECT_CALL(fs, Exists("C:\\bbb.txt")).WillRepeatedly(Return(true));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(sync.Report().unchanged, 1u);
+    EXPECT_EQ(sync.Report().bytesSaved, 11u);
+}
+
+TEST(MirrorSync, SyncDoesNotRewriteIdenticalContent)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    MirrorSync sync(downloader, fs);
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", _, _, _))
+        .Times(2)
+        .WillRepeatedly(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt")).Times(1);
+    EXPECT_CALL(fs, Exists("C:\\bbb.txt")).WillRepeatedly(Return(true));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+}
+
+TEST(MirrorSync, SyncKeepsLocalFileWhenDownloadFails)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    MirrorSync sync(downloader, fs);
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, _, _))
+        .WillOnce(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", LastModified, _, _))
+        .WillOnce(DoAll(SetArgReferee<2>("Not Found"), Return(FetchStatus::Failed)))
+        .WillOnce(Return(FetchStatus::NotModified));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt")).Times(1);
+    EXPECT_CALL(fs, Exists("C:\\bbb.txt")).WillRepeatedly(Return(true));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(sync.Report().failed, 1u);
+    // Index still holds the good copy, so the next run asks with its timestamp again.
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_EQ(sync.Report().unchanged, 1u);
+}
+
+TEST(MirrorSync, SyncRestoresMissingOrMovedFile)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    MirrorSync sync(downloader, fs);
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, _, _))
+        .Times(3)
+        .WillRepeatedly(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+    EXPECT_CALL(fs, Exists("C:\\bbb.txt")).WillOnce(Return(false));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt")).Times(2);
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\ccc.txt")).Times(1);
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\bbb.txt"));
+    EXPECT_TRUE(sync.Sync("http://localhost/aaa.txt", "C:\\ccc.txt"));
+}
+
+TEST(MirrorSync, LoadIndexRestoresSavedIndex)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    std::stringstream index;
+    {
+        MirrorSync sync(downloader, fs);
+        EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", 0, _, _))
+            .WillOnce(DoAll(SetArgReferee<2>("FileContent"), SetArgReferee<3>(LastModified), Return(FetchStatus::Modified)));
+        EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\My Files\\bbb.txt"));
+        sync.Sync("http://localhost/aaa.txt", "C:\\My Files\\bbb.txt");
+        sync.SaveIndex(index);
+    }
+    MirrorSync sync(downloader, fs);
+    sync.LoadIndex(index);
+    EXPECT_CALL(fs, Exists("C:\\My Files\\bbb.txt")).WillOnce(Return(true));
+    EXPECT_CALL(downloader, DownloadDataIfModifiedSince("http://localhost/aaa.txt", LastModified, _, _))
+        .WillOnce(Return(FetchStatus::NotModified));
+    EXPECT_FALSE(sync.Sync("http://localhost/aaa.txt", "C:\\My Files\\bbb.txt"));
+    EXPECT_EQ(sync.Report().bytesSaved, 11u);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+
+struct MirrorEntry
+{
+    // Server's Last-Modified of the mirrored copy, so If-Modified-Since never depends on the local clock.
+    int64_t lastModified = 0;
+    uint64_t size = 0;
+    uint32_t checksum = 0;
+    std::string filePath;
+};
+
+struct MirrorReport
+{
+    size_t downloaded = 0;
+    size_t unchanged = 0;
+    size_t failed = 0;
+    uint64_t bytesDownloaded = 0;
+    uint64_t bytesSaved = 0;
+};
+
+// Keeps a local copy of remote files up to date, only transferring files that changed since the last sync.
+class MirrorSync
+{
+public:
+    MirrorSync(const IDownloader& downloader, const IFsWrapper& fs);
+
+    // Returns true when the file was (re)written. A failed transfer never touches the local file or the index.
+    // A file that is missing or now lives at another path is fetched again even if the server copy is unchanged.
+    bool Sync(const std::string& url, const std::string& filePath);
+
+    // Index is stored as one "lastModified size checksum url filePath" line per entry; the path runs to the end of the line.
+    void LoadIndex(std::istream& in);
+    void SaveIndex(std::ostream& out) const;
+
+    const MirrorReport& Report() const;
+
+private:
+    const IDownloader& m_downloader;
+    const IFsWrapper& m_fs;
+    std::unordered_map<std::string, MirrorEntry> m_index;
+    MirrorReport m_report;
+};
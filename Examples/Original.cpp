@@ -21,7 +21,7 @@ int DownloadFile(void) {
     CURL* curl;
     CURLcode res;
     char url[] = "http://localhost/aaa.txt";
-    std::ofstream fs("C:\\bbb.txt");
+    std::ofstream fs("C:\\bbb.txt", std::ios::binary);
     curl = curl_easy_init();
     if (curl) {
         curl_easy_setopt(curl, CURLOPT_URL, url);
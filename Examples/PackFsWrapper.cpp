@@ -0,0 +1,451 @@
+#include "PackFsWrapper.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <gtest/gtest.h>
+
+namespace
+{
+    template <typename T>
+    void WriteValue(std::ostream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool ReadValue(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+}
+
+PackFsWrapper::PackFsWrapper(const std::string& directory, uint64_t segmentSize)
+    : m_directory(directory)
+    , m_segmentSize(segmentSize)
+{
+    std::filesystem::create_directories(m_directory);
+    LoadIndex();
+}
+
+// Flush reports errors instead of throwing, so nothing escapes here; on failure the previous index stays.
+PackFsWrapper::~PackFsWrapper()
+{
+    Flush();
+}
+
+void PackFsWrapper::SaveToFile(const std::string& data, const std::string& filePath) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const PackLocation location = Append(data);
+    auto result = m_index.emplace(filePath, location);
+    if (!result.second)
+    {
+        m_deadBytes += result.first->second.length;
+        result.first->second = location;
+    }
+}
+
+bool PackFsWrapper::LoadFromFile(const std::string& filePath, std::string& data) const
+{
+    PackLocation location;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_index.find(filePath);
+        if (it == m_index.end())
+        {
+            return false;
+        }
+        location = it->second;
+        ++m_readers[location.segment];
+    }
+    struct ReaderGuard
+    {
+        const PackFsWrapper* self;
+        uint32_t segment;
+        ~ReaderGuard()
+        {
+            std::lock_guard<std::mutex> lock(self->m_mutex);
+            self->ReleaseSegment(segment);
+        }
+    } guard{ this, location.segment };
+
+    std::ifstream segment(SegmentPath(location.segment), std::ios::binary);
+    segment.seekg(static_cast<std::streamoff>(location.offset));
+    data.resize(static_cast<size_t>(location.length));
+    return static_cast<bool>(segment.read(&data[0], static_cast<std::streamsize>(location.length)));
+}
+
+bool PackFsWrapper::Flush() const
+{
+    // Append flushes every file, so the segments already hold everything the index names.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return WriteIndex();
+}
+
+void PackFsWrapper::Compact()
+{
+    std::lock_guard<std::mutex> compactLock(m_compactMutex);
+    std::vector<std::pair<std::string, PackLocation>> live;
+    uint32_t sealed = 0;
+    uint64_t deadAtSnapshot = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sealed = m_segmentId;
+        OpenSegment(NewSegmentId());
+        live.assign(m_index.begin(), m_index.end());
+        deadAtSnapshot = m_deadBytes;
+    }
+
+    // Everything in the snapshot lives in segments up to `sealed`, which nobody appends to any more.
+    std::sort(live.begin(), live.end(), [](const auto& left, const auto& right) {
+        return std::tie(left.second.segment, left.second.offset) < std::tie(right.second.segment, right.second.offset);
+    });
+    std::vector<PackLocation> moved(live.size());
+    std::vector<uint32_t> outputs;
+    std::ofstream output;
+    uint32_t outputId = 0;
+    uint64_t outputOffset = 0;
+    std::ifstream source;
+    uint32_t sourceId = 0;
+    std::string data;
+    bool copied = true;
+    for (size_t i = 0; i < live.size() && copied; ++i)
+    {
+        const PackLocation& from = live[i].second;
+        if (!output.is_open() || (outputOffset > 0 && outputOffset + from.length > m_segmentSize))
+        {
+            output.close();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                outputId = NewSegmentId();
+            }
+            outputs.push_back(outputId);
+            output.open(SegmentPath(outputId), std::ios::binary | std::ios::trunc);
+            outputOffset = 0;
+        }
+        if (!source.is_open() || sourceId != from.segment)
+        {
+            source.close();
+            source.open(SegmentPath(from.segment), std::ios::binary);
+            sourceId = from.segment;
+        }
+        data.resize(static_cast<size_t>(from.length));
+        source.seekg(static_cast<std::streamoff>(from.offset));
+        copied = from.length == 0 || static_cast<bool>(source.read(&data[0], static_cast<std::streamsize>(data.size())));
+        output.write(data.data(), static_cast<std::streamsize>(data.size()));
+        moved[i] = PackLocation{ outputId, outputOffset, from.length };
+        outputOffset += from.length;
+    }
+    source.close();
+    output.close();
+    copied = copied && !output.fail();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (copied)
+    {
+        for (size_t i = 0; i < live.size(); ++i)
+        {
+            // A path written again during the copy keeps its newer location; its copy is dead and was
+            // already counted in m_deadBytes when the old location was overwritten.
+            const auto it = m_index.find(live[i].first);
+            if (it != m_index.end() && it->second.segment == live[i].second.segment
+                && it->second.offset == live[i].second.offset)
+            {
+                it->second = moved[i];
+            }
+        }
+        m_deadBytes -= deadAtSnapshot;
+        // The copies were closed above and the active segment is flushed on every Append, so the new index
+        // never points at bytes that are still only in a stream buffer.
+        copied = WriteIndex();
+    }
+    // On failure the index still points at the old segments, so the new copies are what gets dropped.
+    std::vector<uint32_t> retired = outputs;
+    if (copied)
+    {
+        retired.assign(m_segments.begin(), m_segments.upper_bound(sealed));
+    }
+    for (const uint32_t segment : retired)
+    {
+        m_retired.insert(segment);
+        if (m_readers.count(segment) == 0)
+        {
+            RemoveSegment(segment);
+        }
+    }
+}
+
+uint64_t PackFsWrapper::DeadBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_deadBytes;
+}
+
+std::string PackFsWrapper::SegmentPath(uint32_t segment) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment_%08u.pack", segment);
+    return (std::filesystem::path(m_directory) / name).string();
+}
+
+std::string PackFsWrapper::IndexPath() const
+{
+    return (std::filesystem::path(m_directory) / "index.pack").string();
+}
+
+// Index layout: count, then per entry path length, path bytes, segment, offset, length; sorted by path.
+void PackFsWrapper::LoadIndex()
+{
+    std::ifstream in(IndexPath(), std::ios::binary);
+    uint64_t count = 0;
+    if (in && ReadValue(in, count))
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            uint32_t pathLength = 0;
+            PackLocation location;
+            if (!ReadValue(in, pathLength))
+            {
+                break;
+            }
+            std::string path(pathLength, '\0');
+            if (!in.read(&path[0], pathLength) || !ReadValue(in, location.segment)
+                || !ReadValue(in, location.offset) || !ReadValue(in, location.length))
+            {
+                break;
+            }
+            m_segments.insert(location.segment);
+            m_index.emplace_hint(m_index.end(), std::move(path), location);
+        }
+    }
+    // Never append to a segment from a previous run, its tail may not be covered by the index.
+    m_nextSegmentId = m_segments.empty() ? 0 : *m_segments.rbegin() + 1;
+    OpenSegment(NewSegmentId());
+}
+
+bool PackFsWrapper::WriteIndex() const
+{
+    const std::string tempPath = IndexPath() + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        WriteValue(out, static_cast<uint64_t>(m_index.size()));
+        for (const auto& item : m_index)
+        {
+            WriteValue(out, static_cast<uint32_t>(item.first.size()));
+            out.write(item.first.data(), static_cast<std::streamsize>(item.first.size()));
+            WriteValue(out, item.second.segment);
+            WriteValue(out, item.second.offset);
+            WriteValue(out, item.second.length);
+        }
+        out.close();
+        if (out.fail())
+        {
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, IndexPath(), error);
+    if (error)
+    {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+// Flushed per file so a failed write throws before the index records it. A segment whose write failed is
+// abandoned; the files stored in it before the failure were flushed and stay readable.
+PackLocation PackFsWrapper::Append(const std::string& data) const
+{
+    if (!m_segment || (m_segmentOffset > 0 && m_segmentOffset + data.size() > m_segmentSize))
+    {
+        OpenSegment(NewSegmentId());
+    }
+    PackLocation location{ m_segmentId, m_segmentOffset, data.size() };
+    if (!m_segment.write(data.data(), static_cast<std::streamsize>(data.size())).flush())
+    {
+        throw std::filesystem::filesystem_error("SaveToFile", SegmentPath(m_segmentId),
+                                                std::make_error_code(std::errc::io_error));
+    }
+    m_segmentOffset += data.size();
+    return location;
+}
+
+void PackFsWrapper::OpenSegment(uint32_t segment) const
+{
+    if (m_segment.is_open())
+    {
+        m_segment.close();
+    }
+    m_segmentId = segment;
+    m_segmentOffset = 0;
+    m_segment.open(SegmentPath(segment), std::ios::binary | std::ios::trunc);
+    if (!m_segment)
+    {
+        throw std::filesystem::filesystem_error("OpenSegment", SegmentPath(segment),
+                                                std::make_error_code(std::errc::io_error));
+    }
+}
+
+uint32_t PackFsWrapper::NewSegmentId() const
+{
+    m_segments.insert(m_nextSegmentId);
+    return m_nextSegmentId++;
+}
+
+void PackFsWrapper::ReleaseSegment(uint32_t segment) const
+{
+    const auto it = m_readers.find(segment);
+    if (--it->second == 0)
+    {
+        m_readers.erase(it);
+        if (m_retired.count(segment) > 0)
+        {
+            RemoveSegment(segment);
+        }
+    }
+}
+
+void PackFsWrapper::RemoveSegment(uint32_t segment) const
+{
+    std::error_code error;
+    std::filesystem::remove(SegmentPath(segment), error);
+    m_retired.erase(segment);
+    m_segments.erase(segment);
+}
+
+namespace
+{
+    class PackFsWrapperFixture : public testing::Test
+    {
+    public:
+        void SetUp()
+        {
+            m_directory = (std::filesystem::temp_directory_path() / "PackFsWrapperTest").string();
+            std::filesystem::remove_all(m_directory);
+        }
+
+        void TearDown()
+        {
+            std::filesystem::remove_all(m_directory);
+        }
+
+    protected:
+        std::string m_directory;
+    };
+}
+
+TEST_F(PackFsWrapperFixture, SaveToFile)
+{
+    PackFsWrapper fs(m_directory);
+    fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    fs.SaveToFile("OtherContent", "C:\\ccc.txt");
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\ccc.txt", data));
+    EXPECT_EQ(data, "OtherContent");
+    EXPECT_FALSE(fs.LoadFromFile("C:\\ddd.txt", data));
+}
+
+TEST_F(PackFsWrapperFixture, SaveToFileStartsNewSegmentWhenFull)
+{
+    PackFsWrapper fs(m_directory, 16);
+    fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    fs.SaveToFile("OtherContent", "C:\\ccc.txt");
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\ccc.txt", data));
+    EXPECT_EQ(data, "OtherContent");
+    EXPECT_TRUE(std::filesystem::exists(std::filesystem::path(m_directory) / "segment_00000001.pack"));
+}
+
+TEST_F(PackFsWrapperFixture, IndexIsRestoredOnReopen)
+{
+    {
+        PackFsWrapper fs(m_directory);
+        fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    }
+    PackFsWrapper fs(m_directory);
+    fs.SaveToFile("OtherContent", "C:\\ccc.txt");
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\ccc.txt", data));
+    EXPECT_EQ(data, "OtherContent");
+}
+
+TEST_F(PackFsWrapperFixture, CompactRunsAlongsideReadersAndWriters)
+{
+    PackFsWrapper fs(m_directory, 256);
+    for (int i = 0; i < 200; ++i)
+    {
+        fs.SaveToFile("Content" + std::to_string(i), "C:\\" + std::to_string(i % 50) + ".txt");
+    }
+    std::atomic<bool> stop{ false };
+    std::atomic<int> failedReads{ 0 };
+    std::thread reader([&]() {
+        std::string data;
+        for (int i = 0; !stop; ++i)
+        {
+            if (!fs.LoadFromFile("C:\\" + std::to_string(i % 50) + ".txt", data) || data.compare(0, 7, "Content") != 0)
+            {
+                ++failedReads;
+            }
+        }
+    });
+    std::thread writer([&]() {
+        for (int i = 0; i < 500; ++i)
+        {
+            fs.SaveToFile("Content" + std::to_string(i), "C:\\" + std::to_string(50 + i % 20) + ".txt");
+        }
+    });
+    for (int i = 0; i < 5; ++i)
+    {
+        fs.Compact();
+    }
+    writer.join();
+    stop = true;
+    reader.join();
+    EXPECT_EQ(failedReads, 0);
+
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\49.txt", data));
+    EXPECT_EQ(data, "Content199");
+    ASSERT_TRUE(fs.LoadFromFile("C:\\69.txt", data));
+    EXPECT_EQ(data, "Content499");
+    fs.Compact();
+    EXPECT_EQ(fs.DeadBytes(), 0u);
+}
+
+TEST_F(PackFsWrapperFixture, CompactDropsOverwrittenData)
+{
+    PackFsWrapper fs(m_directory);
+    fs.SaveToFile("OldContent", "C:\\bbb.txt");
+    fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    EXPECT_EQ(fs.DeadBytes(), 10u);
+    fs.Compact();
+    EXPECT_EQ(fs.DeadBytes(), 0u);
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::path(m_directory) / "segment_00000000.pack"));
+    std::string data;
+    ASSERT_TRUE(fs.LoadFromFile("C:\\bbb.txt", data));
+    EXPECT_EQ(data, "FileContent");
+}
+
+TEST_F(PackFsWrapperFixture, SaveToFileThrowsWhenSegmentCannotBeWritten)
+{
+    PackFsWrapper fs(m_directory, 16);
+    fs.SaveToFile("FileContent", "C:\\bbb.txt");
+    std::filesystem::remove_all(m_directory);
+    EXPECT_THROW(fs.SaveToFile("OtherContent", "C:\\ccc.txt"), std::filesystem::filesystem_error);
+    std::string data;
+    EXPECT_FALSE(fs.LoadFromFile("C:\\ccc.txt", data));
+    EXPECT_FALSE(fs.Flush());
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "FsWrapper.h"
+
+struct PackLocation
+{
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+// IFsWrapper that appends files to large segment files instead of creating one file per path.
+// Logical path -> location index is kept sorted and written next to the segments on Flush().
+class PackFsWrapper : public IFsWrapper
+{
+public:
+    explicit PackFsWrapper(const std::string& directory, uint64_t segmentSize = 64 * 1024 * 1024);
+    ~PackFsWrapper();
+
+    virtual void SaveToFile(const std::string& data, const std::string& filePath) const;
+    bool LoadFromFile(const std::string& filePath, std::string& data) const;
+
+    // Returns false when the index could not be written.
+    bool Flush() const;
+    // Copies live data into fresh segments and deletes the old ones, reclaiming overwritten bytes.
+    // Safe to run on a background thread: the copy happens without the lock, writers continue in a
+    // new segment meanwhile, and an old segment is only deleted once no LoadFromFile is reading it.
+    void Compact();
+    uint64_t DeadBytes() const;
+
+private:
+    std::string SegmentPath(uint32_t segment) const;
+    std::string IndexPath() const;
+    void LoadIndex();
+    bool WriteIndex() const;
+    PackLocation Append(const std::string& data) const;
+    void OpenSegment(uint32_t segment) const;
+    // The rest expect m_mutex to be held.
+    uint32_t NewSegmentId() const;
+    void ReleaseSegment(uint32_t segment) const;
+    void RemoveSegment(uint32_t segment) const;
+
+    const std::string m_directory;
+    const uint64_t m_segmentSize;
+    mutable std::mutex m_mutex;
+    std::mutex m_compactMutex;
+    mutable std::map<std::string, PackLocation> m_index;
+    mutable std::ofstream m_segment;
+    mutable uint32_t m_segmentId = 0;
+    mutable uint64_t m_segmentOffset = 0;
+    mutable uint32_t m_nextSegmentId = 0;
+    mutable uint64_t m_deadBytes = 0;
+    // Segment files on disk, readers currently inside each one, and those waiting to be deleted.
+    mutable std::set<uint32_t> m_segments;
+    mutable std::map<uint32_t, size_t> m_readers;
+    mutable std::set<uint32_t> m_retired;
+};
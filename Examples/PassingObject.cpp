@@ -16,6 +16,7 @@ namespace
     class MockDownloader : public Downloader
     {
     public:
+        using Downloader::DownloadData;
         MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
     };
 
@@ -0,0 +1,175 @@
+#include <gmock/gmock.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Downloader.h"
+#include "FsWrapper.h"
+#include "LoopbackDownloader.h"
+
+using namespace testing;
+
+namespace
+{
+    // Every policy derives from the layer below it, so the whole stack is a single type:
+    // DownloadData calls are resolved at compile time and can be inlined into one another.
+    template <class TBase, template <class> class... TPolicies>
+    struct PolicyStack;
+
+    template <class TBase>
+    struct PolicyStack<TBase>
+    {
+        using type = TBase;
+    };
+
+    template <class TBase, template <class> class TPolicy, template <class> class... TRest>
+    struct PolicyStack<TBase, TPolicy, TRest...>
+    {
+        using type = TPolicy<typename PolicyStack<TBase, TRest...>::type>;
+    };
+
+    // First policy is the outermost layer.
+    template <class TBase, template <class> class... TPolicies>
+    using PolicyDownloader = typename PolicyStack<TBase, TPolicies...>::type;
+
+    // Policies are safe to share between threads as long as the layer below them is, since a stack
+    // built on Downloader is an IDownloader and may be handed to DownloadScheduler or HedgingDownloader.
+    template <class TNext>
+    class CountingPolicy : public TNext
+    {
+    public:
+        using TNext::TNext;
+        using TNext::DownloadData;
+
+        std::string DownloadData(const std::string& url) const
+        {
+            m_requests.fetch_add(1, std::memory_order_relaxed);
+            return TNext::DownloadData(url);
+        }
+
+        size_t Requests() const { return m_requests.load(std::memory_order_relaxed); }
+
+    private:
+        mutable std::atomic<size_t> m_requests{ 0 };
+    };
+
+    template <class TNext>
+    class CachingPolicy : public TNext
+    {
+    public:
+        using TNext::TNext;
+        using TNext::DownloadData;
+
+        // The lock is not held while downloading, so two threads missing on the same url may both fetch it.
+        std::string DownloadData(const std::string& url) const
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                const auto it = m_cache.find(url);
+                if (it != m_cache.end())
+                {
+                    return it->second;
+                }
+            }
+            std::string data = TNext::DownloadData(url);
+            if (!data.empty())
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_cache.emplace(url, data);
+            }
+            return data;
+        }
+
+    private:
+        mutable std::mutex m_mutex;
+        mutable std::unordered_map<std::string, std::string> m_cache;
+    };
+
+    template <class TNext>
+    class RetryPolicy : public TNext
+    {
+    public:
+        using TNext::TNext;
+        using TNext::DownloadData;
+
+        std::string DownloadData(const std::string& url) const
+        {
+            std::string data;
+            for (int attempt = 0; attempt < 3 && data.empty(); ++attempt)
+            {
+                data = TNext::DownloadData(url);
+            }
+            return data;
+        }
+    };
+
+    template <typename TDownloader, typename TFsWrapper>
+    int DownloadFile(const TDownloader& downloader, const TFsWrapper& fs) {
+        const auto& downloadedData = downloader.DownloadData("http://localhost/aaa.txt");
+        fs.SaveToFile(downloadedData, "C:\\bbb.txt");
+        return 0;
+    }
+
+    class MockDownloader
+    {
+    public:
+        MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
+    };
+
+    class MockFsWrapper
+    {
+    public:
+        MOCK_CONST_METHOD2(SaveToFile, void(const std::string&, const std::string&));
+    };
+
+    static_assert(std::is_same<PolicyDownloader<Downloader>, Downloader>::value, "empty stack is the base itself");
+    static_assert(sizeof(PolicyDownloader<Downloader, RetryPolicy>) == sizeof(Downloader), "stateless policy adds no size");
+}
+
+TEST(PolicyDownloader, DownloadFileProduceExpectedCalls)
+{
+    PolicyDownloader<MockDownloader, CountingPolicy, RetryPolicy> downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt")).WillOnce(Return("FileContent"));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt"));
+    DownloadFile(downloader, fs);
+    EXPECT_EQ(downloader.Requests(), 1u);
+}
+
+TEST(PolicyDownloader, PoliciesApplyInDeclaredOrder)
+{
+    PolicyDownloader<MockDownloader, CountingPolicy, CachingPolicy, CountingPolicy, RetryPolicy> downloader;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt"))
+        .WillOnce(Return(""))
+        .WillOnce(Return("FileContent"));
+    EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt"), "FileContent");
+    EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt"), "FileContent");
+    using Inner = PolicyDownloader<MockDownloader, CountingPolicy, RetryPolicy>;
+    EXPECT_EQ(downloader.Requests(), 2u);
+    EXPECT_EQ(static_cast<const Inner&>(downloader).Requests(), 1u);
+}
+
+TEST(PolicyDownloader, PoliciesCanBeSharedBetweenThreads)
+{
+    PolicyDownloader<LoopbackDownloader, CountingPolicy, CachingPolicy> downloader([]() { return size_t(64); });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([&downloader]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                downloader.DownloadData("http://localhost/" + std::to_string(i % 10) + ".txt");
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(downloader.Requests(), 8000u);
+    EXPECT_GE(downloader.RequestCount(), 10u);
+    EXPECT_LE(downloader.RequestCount(), 80u);
+}
@@ -0,0 +1,351 @@
+#include "ProcessDownloader.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+#include "LoopbackDownloader.h"
+#include "ShardedDownloader.h"
+
+namespace
+{
+    // Frames are a 64-bit length followed by the payload. Responses carry one status byte in front.
+    enum : uint8_t { kOk = 0, kError = 1 };
+
+    bool WriteAll(int socket, const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0)
+        {
+            const ssize_t written = send(socket, bytes, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    enum class ReadResult { Ok, Closed, TimedOut };
+
+    // Waits at most `timeoutMs` for each piece of data, or forever when it is negative.
+    ReadResult ReadAll(int socket, void* data, size_t size, int timeoutMs = -1)
+    {
+        char* bytes = static_cast<char*>(data);
+        while (size > 0)
+        {
+            pollfd ready{ socket, POLLIN, 0 };
+            const int events = poll(&ready, 1, timeoutMs);
+            if (events < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (events == 0)
+            {
+                return ReadResult::TimedOut;
+            }
+            const ssize_t read = events < 0 ? -1 : recv(socket, bytes, size, 0);
+            if (read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (read <= 0)
+            {
+                return ReadResult::Closed;
+            }
+            bytes += read;
+            size -= static_cast<size_t>(read);
+        }
+        return ReadResult::Ok;
+    }
+
+    bool WriteFrame(int socket, const std::string& payload)
+    {
+        const uint64_t size = payload.size();
+        return WriteAll(socket, &size, sizeof(size)) && WriteAll(socket, payload.data(), payload.size());
+    }
+
+    ReadResult ReadFrame(int socket, std::string& payload, int timeoutMs = -1)
+    {
+        uint64_t size = 0;
+        const ReadResult result = ReadAll(socket, &size, sizeof(size), timeoutMs);
+        if (result != ReadResult::Ok)
+        {
+            return result;
+        }
+        payload.resize(size);
+        return ReadAll(socket, &payload[0], payload.size(), timeoutMs);
+    }
+
+    void ServeRequests(int socket, const ProcessDownloader::Factory& factory)
+    {
+        std::unique_ptr<IDownloader> downloader = factory();
+        std::string url;
+        while (ReadFrame(socket, url) == ReadResult::Ok)
+        {
+            uint8_t status = kOk;
+            std::string response;
+            try
+            {
+                response = downloader->DownloadData(url);
+            }
+            catch (const std::exception& e)
+            {
+                status = kError;
+                response = e.what();
+            }
+            catch (...)
+            {
+                status = kError;
+                response = "Unknown error";
+            }
+            if (!WriteAll(socket, &status, sizeof(status)) || !WriteFrame(socket, response))
+            {
+                return;
+            }
+        }
+    }
+}
+
+ProcessDownloader::ProcessDownloader(Factory factory, std::chrono::milliseconds timeout)
+    : m_factory(std::move(factory))
+    , m_timeout(timeout)
+{
+    Start();
+}
+
+ProcessDownloader::~ProcessDownloader()
+{
+    Stop();
+}
+
+void ProcessDownloader::Start()
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+    {
+        throw std::runtime_error("Cannot create worker socket");
+    }
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(sockets[0]);
+        close(sockets[1]);
+        throw std::runtime_error("Cannot start worker process");
+    }
+    if (pid == 0)
+    {
+        close(sockets[0]);
+        int code = 0;
+        try
+        {
+            ServeRequests(sockets[1], m_factory);
+        }
+        catch (...)
+        {
+            code = 1;
+        }
+        // Skip the parent's atexit handlers and static destructors; they belong to the parent.
+        _exit(code);
+    }
+    close(sockets[1]);
+    m_socket = sockets[0];
+    m_pid = pid;
+}
+
+void ProcessDownloader::Stop() const
+{
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+        m_socket = -1;
+    }
+    if (m_pid > 0)
+    {
+        kill(m_pid, SIGKILL);
+        while (waitpid(m_pid, nullptr, 0) < 0 && errno == EINTR)
+        {
+        }
+        m_pid = -1;
+    }
+}
+
+std::string ProcessDownloader::DownloadData(const std::string& url) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_socket < 0)
+    {
+        throw WorkerUnavailable("Worker process is not running");
+    }
+    if (!WriteFrame(m_socket, url))
+    {
+        Stop();
+        throw WorkerUnavailable("Worker process exited");
+    }
+    const int timeoutMs = static_cast<int>(m_timeout.count());
+    uint8_t status = kError;
+    std::string response;
+    ReadResult result = ReadAll(m_socket, &status, sizeof(status), timeoutMs);
+    if (result == ReadResult::Ok)
+    {
+        result = ReadFrame(m_socket, response, timeoutMs);
+    }
+    if (result != ReadResult::Ok)
+    {
+        // A hung worker is killed too: its late reply would otherwise be read as the next request's.
+        Stop();
+        throw WorkerUnavailable(result == ReadResult::TimedOut ? "Worker process timed out" : "Worker process exited");
+    }
+    if (status != kOk)
+    {
+        throw std::runtime_error(response);
+    }
+    return response;
+}
+
+void ProcessDownloader::Restart()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stop();
+    Start();
+}
+
+void ProcessDownloader::Kill()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pid > 0)
+    {
+        kill(m_pid, SIGKILL);
+    }
+}
+
+pid_t ProcessDownloader::Pid() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pid;
+}
+
+namespace
+{
+    class PidDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        virtual std::string DownloadData(const std::string& url) const
+        {
+            if (url.find("missing") != std::string::npos)
+            {
+                throw std::runtime_error("404 " + url);
+            }
+            if (url.find("hang") != std::string::npos)
+            {
+                pause();
+            }
+            return std::to_string(getpid()) + " " + url;
+        }
+    };
+}
+
+TEST(ProcessDownloader, DownloadDataRunsInWorkerProcess)
+{
+    ProcessDownloader downloader([]() { return std::unique_ptr<IDownloader>(new PidDownloader()); });
+    const std::string data = downloader.DownloadData("http://localhost/aaa.txt");
+    EXPECT_EQ(data, std::to_string(downloader.Pid()) + " http://localhost/aaa.txt");
+    EXPECT_NE(downloader.Pid(), getpid());
+}
+
+TEST(ProcessDownloader, DownloadDataForwardsWorkerErrors)
+{
+    ProcessDownloader downloader([]() { return std::unique_ptr<IDownloader>(new PidDownloader()); });
+    try
+    {
+        downloader.DownloadData("http://localhost/missing.txt");
+        FAIL();
+    }
+    catch (const WorkerUnavailable&)
+    {
+        FAIL();
+    }
+    catch (const std::runtime_error& e)
+    {
+        EXPECT_STREQ(e.what(), "404 http://localhost/missing.txt");
+    }
+    EXPECT_NE(downloader.DownloadData("http://localhost/aaa.txt"), "");
+}
+
+TEST(ProcessDownloader, DeadWorkerIsUnavailableUntilRestart)
+{
+    ProcessDownloader downloader([]() { return std::unique_ptr<IDownloader>(new PidDownloader()); });
+    downloader.Kill();
+    EXPECT_THROW(downloader.DownloadData("http://localhost/aaa.txt"), WorkerUnavailable);
+    EXPECT_THROW(downloader.DownloadData("http://localhost/aaa.txt"), WorkerUnavailable);
+    downloader.Restart();
+    EXPECT_NE(downloader.DownloadData("http://localhost/aaa.txt"), "");
+}
+
+TEST(ProcessDownloader, HungWorkerTimesOutAndIsStopped)
+{
+    ProcessDownloader downloader([]() { return std::unique_ptr<IDownloader>(new PidDownloader()); },
+                                 std::chrono::milliseconds(100));
+    try
+    {
+        downloader.DownloadData("http://localhost/hang.txt");
+        FAIL();
+    }
+    catch (const WorkerUnavailable& e)
+    {
+        EXPECT_STREQ(e.what(), "Worker process timed out");
+    }
+    EXPECT_EQ(downloader.Pid(), -1);
+    downloader.Restart();
+    EXPECT_NE(downloader.DownloadData("http://localhost/aaa.txt"), "");
+}
+
+TEST(ProcessDownloader, ShardedWorkersRebalanceAndRejoin)
+{
+    std::vector<std::shared_ptr<ProcessDownloader>> processes;
+    for (int i = 0; i < 3; ++i)
+    {
+        processes.push_back(std::make_shared<ProcessDownloader>(
+            []() { return std::unique_ptr<IDownloader>(new LoopbackDownloader([]() { return size_t(64); })); }));
+    }
+    ShardedDownloader downloader({ processes.begin(), processes.end() });
+    std::vector<std::string> urls;
+    for (int i = 0; i < 60; ++i)
+    {
+        urls.push_back("http://localhost/" + std::to_string(i) + ".txt");
+    }
+
+    processes[1]->Kill();
+    for (const auto& url : urls)
+    {
+        EXPECT_EQ(downloader.DownloadData(url).size(), 64u);
+    }
+    EXPECT_FALSE(downloader.Stats()[1].alive);
+
+    processes[1]->Restart();
+    downloader.RejoinWorker(1);
+    const size_t before = downloader.Stats()[1].requests;
+    for (const auto& url : urls)
+    {
+        EXPECT_EQ(downloader.DownloadData(url).size(), 64u);
+    }
+    const auto stats = downloader.Stats();
+    EXPECT_TRUE(stats[1].alive);
+    EXPECT_GT(stats[1].requests, before);
+    EXPECT_EQ(stats[0].bytes + stats[1].bytes + stats[2].bytes, 120u * 64u);
+}
+#endif
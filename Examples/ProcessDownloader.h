@@ -0,0 +1,43 @@
+#pragma once
+#ifndef _WIN32
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+#include "Downloader.h"
+
+// Runs an IDownloader in a forked worker process and forwards DownloadData to it over a Unix domain
+// socket, so each worker has its own file descriptors, heap and curl global state. Errors thrown by
+// the worker's downloader come back as std::runtime_error; a dead worker or broken socket is reported
+// as WorkerUnavailable until Restart. So is a worker that sends nothing for `timeout`, which is then
+// killed. Requests to one worker are serialized.
+// The factory runs in the child right after fork, so start workers before the process spawns threads
+// that may hold locks the factory needs.
+class ProcessDownloader : public IDownloader
+{
+public:
+    using Factory = std::function<std::unique_ptr<IDownloader>()>;
+
+    explicit ProcessDownloader(Factory factory, std::chrono::milliseconds timeout = std::chrono::seconds(60));
+    ~ProcessDownloader();
+
+    using IDownloader::DownloadData;
+    virtual std::string DownloadData(const std::string& url) const;
+    void Restart();
+    void Kill();
+    pid_t Pid() const;
+
+private:
+    void Start();
+    void Stop() const;
+
+    Factory m_factory;
+    const std::chrono::milliseconds m_timeout;
+    mutable std::mutex m_mutex;
+    mutable int m_socket = -1;
+    mutable pid_t m_pid = -1;
+};
+#endif
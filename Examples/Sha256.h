@@ -0,0 +1,28 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental SHA-256 (FIPS 180-4), for checking downloads against published digests.
+class Sha256
+{
+public:
+    Sha256();
+
+    void Update(const void* data, size_t size);
+    // Finishes the hash; the object must not be updated afterwards.
+    std::array<uint8_t, 32> Digest();
+    // Lower-case hex, the form digests are usually published in.
+    std::string HexDigest();
+
+    static std::string Compute(const void* data, size_t size);
+
+private:
+    void Transform(const unsigned char* block);
+
+    std::array<uint32_t, 8> m_state;
+    std::array<unsigned char, 64> m_buffer{};
+    size_t m_buffered = 0;
+    uint64_t m_length = 0;
+};
@@ -0,0 +1,356 @@
+#include "ShardedDownloader.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <gmock/gmock.h>
+
+using namespace testing;
+
+namespace
+{
+    // FNV-1a, stable across platforms and runs unlike std::hash.
+    uint64_t Hash(const std::string& key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (const char c : key)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        // Final mix so that keys differing only in the last characters spread over the whole ring.
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+}
+
+ConsistentHashRing::ConsistentHashRing(size_t virtualNodes)
+    : m_virtualNodes(virtualNodes)
+{}
+
+void ConsistentHashRing::AddNode(size_t node)
+{
+    for (size_t i = 0; i < m_virtualNodes; ++i)
+    {
+        m_ring[Hash(std::to_string(node) + "#" + std::to_string(i))] = node;
+    }
+}
+
+void ConsistentHashRing::RemoveNode(size_t node)
+{
+    for (auto it = m_ring.begin(); it != m_ring.end();)
+    {
+        it = it->second == node ? m_ring.erase(it) : std::next(it);
+    }
+}
+
+bool ConsistentHashRing::NodeFor(const std::string& key, size_t& node) const
+{
+    if (m_ring.empty())
+    {
+        return false;
+    }
+    auto it = m_ring.lower_bound(Hash(key));
+    node = (it == m_ring.end() ? m_ring.begin() : it)->second;
+    return true;
+}
+
+std::vector<size_t> ConsistentHashRing::NodesFor(const std::string& key, size_t count) const
+{
+    std::vector<size_t> nodes;
+    if (m_ring.empty())
+    {
+        return nodes;
+    }
+    const auto start = m_ring.lower_bound(Hash(key));
+    auto it = start;
+    do
+    {
+        if (it == m_ring.end())
+        {
+            it = m_ring.begin();
+        }
+        if (std::find(nodes.begin(), nodes.end(), it->second) == nodes.end())
+        {
+            nodes.push_back(it->second);
+        }
+        ++it;
+    } while (nodes.size() < count && it != start);
+    return nodes;
+}
+
+ShardedDownloader::ShardedDownloader(std::vector<std::shared_ptr<IDownloader>> workers, size_t maxConsecutiveFailures)
+    : m_workers(std::move(workers))
+    , m_maxConsecutiveFailures(maxConsecutiveFailures > 0 ? maxConsecutiveFailures : 1)
+    , m_stats(m_workers.size())
+{
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_ring.AddNode(i);
+    }
+}
+
+std::string ShardedDownloader::DownloadData(const std::string& url) const
+{
+    std::vector<size_t> candidates;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        candidates = m_ring.NodesFor(url, 2);
+    }
+    if (candidates.empty())
+    {
+        throw std::runtime_error("No download workers left");
+    }
+    // A plain error may be about the URL (404) rather than the worker. It only counts against the worker
+    // when the failover then serves the same URL; if both fail, the URL is blamed and nobody is evicted.
+    std::exception_ptr error;
+    size_t suspect = candidates.size();
+    for (const size_t worker : candidates)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats[worker].requests;
+        }
+        try
+        {
+            std::string data = m_workers[worker]->DownloadData(url);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats[worker].bytes += data.size();
+            m_stats[worker].consecutiveFailures = 0;
+            if (suspect < candidates.size())
+            {
+                RecordFault(suspect, false);
+            }
+            return data;
+        }
+        catch (const WorkerUnavailable&)
+        {
+            error = std::current_exception();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats[worker].failures;
+            RecordFault(worker, true);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats[worker].failures;
+            suspect = worker;
+        }
+    }
+    std::rethrow_exception(error);
+}
+
+void ShardedDownloader::RecordFault(size_t worker, bool unavailable) const
+{
+    ShardStats& stats = m_stats[worker];
+    ++stats.consecutiveFailures;
+    if (stats.alive && (unavailable || stats.consecutiveFailures >= m_maxConsecutiveFailures))
+    {
+        stats.alive = false;
+        m_ring.RemoveNode(worker);
+    }
+}
+
+void ShardedDownloader::RemoveWorker(size_t worker) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats[worker].alive)
+    {
+        m_stats[worker].alive = false;
+        m_ring.RemoveNode(worker);
+    }
+}
+
+void ShardedDownloader::RejoinWorker(size_t worker) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stats[worker].alive)
+    {
+        m_stats[worker].alive = true;
+        m_stats[worker].consecutiveFailures = 0;
+        m_ring.AddNode(worker);
+    }
+}
+
+std::vector<ShardStats> ShardedDownloader::Stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+namespace
+{
+    class MockDownloader : public IDownloader
+    {
+    public:
+        using IDownloader::DownloadData;
+        MOCK_CONST_METHOD1(DownloadData, std::string(const std::string&));
+    };
+
+    std::vector<std::string> MakeUrls(size_t count)
+    {
+        std::vector<std::string> urls;
+        for (size_t i = 0; i < count; ++i)
+        {
+            urls.push_back("http://localhost/" + std::to_string(i) + ".txt");
+        }
+        return urls;
+    }
+}
+
+TEST(ConsistentHashRing, RemoveNodeMovesOnlyItsKeys)
+{
+    ConsistentHashRing ring;
+    for (size_t node = 0; node < 4; ++node)
+    {
+        ring.AddNode(node);
+    }
+    const auto urls = MakeUrls(1000);
+    std::vector<size_t> before;
+    std::vector<size_t> perNode(4);
+    for (const auto& url : urls)
+    {
+        size_t node = 0;
+        ASSERT_TRUE(ring.NodeFor(url, node));
+        before.push_back(node);
+        ++perNode[node];
+    }
+    for (const size_t count : perNode)
+    {
+        EXPECT_GT(count, 100u);
+    }
+    ring.RemoveNode(2);
+    for (size_t i = 0; i < urls.size(); ++i)
+    {
+        size_t node = 0;
+        ASSERT_TRUE(ring.NodeFor(urls[i], node));
+        EXPECT_NE(node, 2u);
+        if (before[i] != 2)
+        {
+            EXPECT_EQ(node, before[i]);
+        }
+    }
+}
+
+TEST(ShardedDownloader, DownloadDataUsesSameWorkerForSameUrl)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    ON_CALL(*first, DownloadData(_)).WillByDefault(Return("FileContent"));
+    ON_CALL(*second, DownloadData(_)).WillByDefault(Return("FileContent"));
+    ShardedDownloader downloader({ first, second });
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_EQ(downloader.DownloadData("http://localhost/aaa.txt"), "FileContent");
+    }
+    const auto stats = downloader.Stats();
+    EXPECT_EQ(stats[0].requests + stats[1].requests, 10u);
+    EXPECT_TRUE(stats[0].requests == 10 || stats[1].requests == 10);
+    EXPECT_EQ(stats[0].bytes + stats[1].bytes, 110u);
+}
+
+TEST(ShardedDownloader, DownloadDataRemovesWorkerAfterConsecutiveFailures)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    ON_CALL(*first, DownloadData(_)).WillByDefault(Throw(std::runtime_error("worker broken")));
+    ON_CALL(*second, DownloadData(_)).WillByDefault(Return("FileContent"));
+    ShardedDownloader downloader({ first, second });
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+    }
+    const auto stats = downloader.Stats();
+    EXPECT_FALSE(stats[0].alive);
+    EXPECT_EQ(stats[0].failures, 3u);
+    EXPECT_EQ(stats[1].requests, 20u);
+}
+
+TEST(ShardedDownloader, DownloadDataRethrowsAfterOneFailover)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    auto third = std::make_shared<NiceMock<MockDownloader>>();
+    for (const auto& worker : { first, second, third })
+    {
+        ON_CALL(*worker, DownloadData(_)).WillByDefault(Return("FileContent"));
+        ON_CALL(*worker, DownloadData("http://localhost/missing.txt")).WillByDefault(Throw(std::runtime_error("404")));
+    }
+    ShardedDownloader downloader({ first, second, third });
+    EXPECT_THROW(downloader.DownloadData("http://localhost/missing.txt"), std::runtime_error);
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+    }
+    const auto stats = downloader.Stats();
+    size_t failures = 0;
+    for (const auto& worker : stats)
+    {
+        EXPECT_TRUE(worker.alive);
+        failures += worker.failures;
+    }
+    EXPECT_EQ(failures, 2u);
+}
+
+TEST(ShardedDownloader, FailingUrlsDoNotEvictWorkers)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    for (const auto& worker : { first, second })
+    {
+        ON_CALL(*worker, DownloadData(_)).WillByDefault(Throw(std::runtime_error("404")));
+    }
+    ShardedDownloader downloader({ first, second });
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_THROW(downloader.DownloadData(url), std::runtime_error);
+    }
+    for (const auto& worker : downloader.Stats())
+    {
+        EXPECT_TRUE(worker.alive);
+        EXPECT_EQ(worker.consecutiveFailures, 0u);
+    }
+}
+
+TEST(ShardedDownloader, DownloadDataFailsOverOnNonStandardException)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    ON_CALL(*first, DownloadData(_)).WillByDefault(Throw(42));
+    ON_CALL(*second, DownloadData(_)).WillByDefault(Return("FileContent"));
+    ShardedDownloader downloader({ first, second });
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+    }
+    EXPECT_FALSE(downloader.Stats()[0].alive);
+    EXPECT_THROW(ShardedDownloader({ first }).DownloadData("http://localhost/aaa.txt"), int);
+}
+
+TEST(ShardedDownloader, UnavailableWorkerLeavesAndRejoins)
+{
+    auto first = std::make_shared<NiceMock<MockDownloader>>();
+    auto second = std::make_shared<NiceMock<MockDownloader>>();
+    ON_CALL(*first, DownloadData(_)).WillByDefault(Throw(WorkerUnavailable("worker died")));
+    ON_CALL(*second, DownloadData(_)).WillByDefault(Return("FileContent"));
+    ShardedDownloader downloader({ first, second });
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+    }
+    EXPECT_FALSE(downloader.Stats()[0].alive);
+    EXPECT_EQ(downloader.Stats()[0].failures, 1u);
+
+    ON_CALL(*first, DownloadData(_)).WillByDefault(Return("FileContent"));
+    downloader.RejoinWorker(0);
+    for (const auto& url : MakeUrls(20))
+    {
+        EXPECT_EQ(downloader.DownloadData(url), "FileContent");
+    }
+    const auto stats = downloader.Stats();
+    EXPECT_TRUE(stats[0].alive);
+    EXPECT_GT(stats[0].requests, 1u);
+    EXPECT_EQ(stats[0].requests + stats[1].requests, 41u);
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Downloader.h"
+
+// Maps keys to nodes so that removing a node only moves the keys that node owned.
+class ConsistentHashRing
+{
+public:
+    explicit ConsistentHashRing(size_t virtualNodes = 64);
+
+    void AddNode(size_t node);
+    void RemoveNode(size_t node);
+    bool NodeFor(const std::string& key, size_t& node) const;
+    // Up to `count` distinct nodes in ring order starting at the owner of `key`.
+    std::vector<size_t> NodesFor(const std::string& key, size_t count) const;
+
+private:
+    const size_t m_virtualNodes;
+    std::map<uint64_t, size_t> m_ring;
+};
+
+struct ShardStats
+{
+    bool alive = true;
+    size_t requests = 0;
+    size_t failures = 0;
+    size_t consecutiveFailures = 0;
+    uint64_t bytes = 0;
+};
+
+// Thrown by a worker that cannot serve any request (its process died, its connection broke), as
+// opposed to an error about one particular URL.
+class WorkerUnavailable : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Spreads URLs over worker downloaders by consistent hashing, so the same URL keeps hitting the same
+// worker (and its connections and caches). A failed request is retried once on the next worker in the
+// ring and then rethrown to the caller. A worker leaves the ring when it throws WorkerUnavailable or
+// after `maxConsecutiveFailures` requests in a row that it failed but its failover served, and comes
+// back through RejoinWorker. A URL that fails on both workers is not held against either.
+class ShardedDownloader : public IDownloader
+{
+public:
+    explicit ShardedDownloader(std::vector<std::shared_ptr<IDownloader>> workers, size_t maxConsecutiveFailures = 3);
+
+    using IDownloader::DownloadData;
+    virtual std::string DownloadData(const std::string& url) const;
+    void RemoveWorker(size_t worker) const;
+    void RejoinWorker(size_t worker) const;
+    std::vector<ShardStats> Stats() const;
+
+private:
+    // Expects m_mutex to be held.
+    void RecordFault(size_t worker, bool unavailable) const;
+
+    std::vector<std::shared_ptr<IDownloader>> m_workers;
+    const size_t m_maxConsecutiveFailures;
+    mutable std::mutex m_mutex;
+    mutable ConsistentHashRing m_ring;
+    mutable std::vector<ShardStats> m_stats;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each side keeps a cached copy of the other side's index and only reloads it when the ring
+// looks full (or empty), so in steady state the two threads don't touch each other's cache line.
+template <typename T>
+class SpscRing
+{
+public:
+    // Capacity is rounded up to a power of two.
+    explicit SpscRing(size_t capacity)
+        : m_mask(RoundUp(capacity) - 1)
+        , m_slots(m_mask + 1)
+    {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer only. Leaves `value` untouched and returns false when the ring is full.
+    bool TryPush(T&& value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead > m_mask)
+            {
+                return false;
+            }
+        }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only.
+    bool TryPop(T& value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+        value = std::move(m_slots[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Capacity() const { return m_mask + 1; }
+
+private:
+    static size_t RoundUp(size_t capacity)
+    {
+        size_t result = 1;
+        while (result < capacity)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t m_mask;
+    std::vector<T> m_slots;
+
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    size_t m_cachedTail = 0;
+
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    size_t m_cachedHead = 0;
+};
@@ -1,24 +1,87 @@
 #include <stdio.h>
+#include <algorithm>
+#include "BufferPool.h"
 #include <curl/curl.h>
 #include <string>
 #include <gmock/gmock.h>
 #include <filesystem>
-#include <sstream>
 #include <fstream>
 
 using namespace testing;
 
 namespace
 {
+    struct WriteContext
+    {
+        CURL* curl;
+        std::string* data;
+        PooledBuffer* buffer;
+        bool pooled;
+    };
+
+    const double kMaxPresize = 64 * 1024 * 1024;
+
     size_t WriteData(void* contents, size_t size, size_t nmemb, void* userp) {
 
         const size_t realsize = size * nmemb;
-        std::ostream* const stream = static_cast<std::ostream*>(userp);
-        if (stream != nullptr)
+        WriteContext* const context = static_cast<WriteContext*>(userp);
+        try
+        {
+            if (context->data->empty() && !context->pooled)
+            {
+                double contentLength = -1;
+                if (curl_easy_getinfo(context->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &contentLength) == CURLE_OK
+                    && contentLength > 0)
+                {
+                    context->data->reserve(static_cast<size_t>(std::min(contentLength, kMaxPresize)));
+                }
+                else
+                {
+                    context->pooled = true;
+                }
+            }
+            if (context->pooled)
+            {
+                context->buffer->Append(static_cast<const char*>(contents), realsize);
+            }
+            else
+            {
+                context->data->append(static_cast<const char*>(contents), realsize);
+            }
+            return realsize;
+        }
+        catch (...)
+        {
+            return 0;
+        }
+    }
+
+    class CurlHandle
+    {
+    public:
+        CurlHandle() : m_curl(curl_easy_init()) {}
+        ~CurlHandle()
         {
-            stream->write(static_cast<const char*>(contents), realsize);
+            if (m_curl) {
+                curl_easy_cleanup(m_curl);
+            }
+        }
+        CurlHandle(const CurlHandle&) = delete;
+        CurlHandle& operator=(const CurlHandle&) = delete;
+
+        CURL* Get() const { return m_curl; }
+
+    private:
+        CURL* m_curl;
+    };
+
+    CURL* AcquireCurl()
+    {
+        thread_local CurlHandle handle;
+        if (handle.Get()) {
+            curl_easy_reset(handle.Get());
         }
-        return realsize;
+        return handle.Get();
     }
 
     class Downloader
@@ -26,19 +89,23 @@ namespace
     public:
         virtual std::string DownloadData(const std::string& url) const
         {
-            std::stringstream ss;
+            std::string data;
             CURL* curl;
             CURLcode res;
 
-            curl = curl_easy_init();
+            curl = AcquireCurl();
             if (curl) {
-                curl_easy_setopt(curl, CURLOPT_URL, url);
+                PooledBuffer buffer;
+                WriteContext context{ curl, &data, &buffer, false };
+                curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
                 curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteData);
-                curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ss);
+                curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
                 res = curl_easy_perform(curl);
-                curl_easy_cleanup(curl);
+                if (context.pooled) {
+                    data.assign(buffer.Data(), buffer.Size());
+                }
             }
-            return ss.str();
+            return data;
         }
     };
 
@@ -47,7 +114,7 @@ namespace
     public:
         virtual void SaveToFile(const std::string& data, const std::string& filePath) const
         {
-            std::ofstream fs(filePath);
+            std::ofstream fs(filePath, std::ios::binary);
             fs.write(data.data(), data.size());
         }
     };
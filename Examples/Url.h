@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Components of a URL, as views into the text they were parsed from. User info and fragment are dropped;
+// an IPv6 host is returned without its brackets.
+struct UrlParts
+{
+    std::string_view scheme;
+    std::string_view host;
+    std::string_view port;
+    std::string_view path;
+    std::string_view query;
+};
+
+// Interned, pre-parsed URL. Constructing the same URL twice yields the same storage, so copies and
+// comparisons are pointer-sized, and the text can be handed to curl without building a std::string.
+// Interned strings live until the process exits, so use it for a bounded set of endpoints.
+class Url
+{
+public:
+    explicit Url(std::string_view url);
+
+    // Parses without interning, for callers that only need a component of a one-off URL.
+    static UrlParts Parse(std::string_view url);
+
+    const std::string& Str() const { return *m_url; }
+    const char* CStr() const { return m_url->c_str(); }
+    std::string_view Scheme() const { return m_parts.scheme; }
+    std::string_view Host() const { return m_parts.host; }
+    std::string_view Port() const { return m_parts.port; }
+    std::string_view Path() const { return m_parts.path; }
+    std::string_view Query() const { return m_parts.query; }
+
+    bool operator==(const Url& other) const { return m_url == other.m_url; }
+    bool operator!=(const Url& other) const { return m_url != other.m_url; }
+
+private:
+    const std::string* m_url;
+    UrlParts m_parts;
+};
+
+namespace std
+{
+    template <>
+    struct hash<Url>
+    {
+        size_t operator()(const Url& url) const { return hash<const void*>()(&url.Str()); }
+    };
+}
@@ -0,0 +1,92 @@
+#include <gmock/gmock.h>
+
+#include "Crc32c.h"
+#include "Downloader.h"
+#include "FsWrapper.h"
+#include "Sha256.h"
+
+using namespace testing;
+
+namespace
+{
+    // Checksum is computed by the downloader while receiving, so corrupted data never reaches the disk.
+    int DownloadFile(const Downloader& downloader, const FsWrapper& fs, uint32_t expectedChecksum) {
+        uint32_t checksum = 0;
+        const auto& downloadedData = downloader.DownloadData("http://localhost/aaa.txt", checksum);
+        if (checksum != expectedChecksum)
+        {
+            return 1;
+        }
+        fs.SaveToFile(downloadedData, "C:\\bbb.txt");
+        return 0;
+    }
+
+    // Published digests are SHA-256; unlike CRC-32C it also detects deliberate tampering.
+    int DownloadFile(const Downloader& downloader, const FsWrapper& fs, const std::string& expectedSha256) {
+        std::string sha256;
+        const auto& downloadedData = downloader.DownloadData("http://localhost/aaa.txt", sha256);
+        if (sha256 != expectedSha256)
+        {
+            return 1;
+        }
+        fs.SaveToFile(downloadedData, "C:\\bbb.txt");
+        return 0;
+    }
+
+    class MockDownloader : public Downloader
+    {
+    public:
+        using Downloader::DownloadData;
+        MOCK_CONST_METHOD2(DownloadData, std::string(const std::string&, uint32_t&));
+        MOCK_CONST_METHOD2(DownloadData, std::string(const std::string&, std::string&));
+    };
+
+    class MockFsWrapper : public FsWrapper
+    {
+    public:
+        MOCK_CONST_METHOD2(SaveToFile, void(const std::string&, const std::string&));
+    };
+
+    const uint32_t FileContentChecksum = Crc32c::Compute("FileContent", 11);
+    const std::string FileContentSha256 = Sha256::Compute("FileContent", 11);
+}
+
+TEST(VerifiedDownload, DownloadFileSavesDataWithMatchingChecksum)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt", An<uint32_t&>()))
+        .WillOnce(DoAll(SetArgReferee<1>(FileContentChecksum), Return("FileContent")));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt"));
+    EXPECT_EQ(DownloadFile(downloader, fs, FileContentChecksum), 0);
+}
+
+TEST(VerifiedDownload, DownloadFileDoesNotSaveDataWithWrongChecksum)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt", An<uint32_t&>()))
+        .WillOnce(DoAll(SetArgReferee<1>(FileContentChecksum + 1), Return("FileC0ntent")));
+    EXPECT_CALL(fs, SaveToFile(_, _)).Times(0);
+    EXPECT_EQ(DownloadFile(downloader, fs, FileContentChecksum), 1);
+}
+
+TEST(VerifiedDownload, DownloadFileSavesDataWithMatchingSha256)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt", An<std::string&>()))
+        .WillOnce(DoAll(SetArgReferee<1>(FileContentSha256), Return("FileContent")));
+    EXPECT_CALL(fs, SaveToFile("FileContent", "C:\\bbb.txt"));
+    EXPECT_EQ(DownloadFile(downloader, fs, FileContentSha256), 0);
+}
+
+TEST(VerifiedDownload, DownloadFileDoesNotSaveDataWithWrongSha256)
+{
+    MockDownloader downloader;
+    MockFsWrapper fs;
+    EXPECT_CALL(downloader, DownloadData("http://localhost/aaa.txt", An<std::string&>()))
+        .WillOnce(DoAll(SetArgReferee<1>(Sha256::Compute("FileC0ntent", 11)), Return("FileC0ntent")));
+    EXPECT_CALL(fs, SaveToFile(_, _)).Times(0);
+    EXPECT_EQ(DownloadFile(downloader, fs, FileContentSha256), 1);
+}